@@ -0,0 +1,366 @@
+#include "autocomplete.h"
+using namespace std;
+
+// how many typos are allowed for a word of this length
+static int maxEdits(size_t length){
+    if (length < 3) return 0;
+    if (length < 6) return 1;
+    return 2;
+}
+
+// every string that can be made by deleting up to edits characters from word (including word itself),
+// ordered by how many characters were deleted so the closest variants come first
+static void generateDeletes(const string& word, int edits, vector<string>& out){
+    out.clear();
+    out.push_back(word);
+    size_t start = 0;
+    for (int e = 0; e < edits; e++){
+        size_t end = out.size();
+        for (size_t i = start; i < end; i++){
+            if (out[i].size() <= 1){
+                continue;
+            }
+            for (size_t c = 0; c < out[i].size(); c++){
+                string shorter = out[i];
+                shorter.erase(c, 1);
+                out.push_back(shorter);
+            }
+        }
+        // duplicates can only come from the same level since every level is one character shorter
+        sort(out.begin() + end, out.end());
+        out.erase(unique(out.begin() + end, out.end()), out.end());
+        start = end;
+    }
+}
+
+static uint64_t deleteHash(const string& s){
+    return hash<string>{}(s);
+}
+
+vector<string> tokenize(const string& text){
+    vector<string> tokens;
+    string curr;
+    for (char c : text){
+        unsigned char u = static_cast<unsigned char>(c);
+        // bytes above 127 are part of utf-8 characters so keep them in the word
+        if (u >= 128 || isalnum(u)){
+            curr += static_cast<char>(tolower(u));
+        }
+        else if (!curr.empty()){
+            tokens.push_back(curr);
+            curr.clear();
+        }
+    }
+    if (!curr.empty()){
+        tokens.push_back(curr);
+    }
+    return tokens;
+}
+
+int editDistance(const string& a, const string& b, int maxDistance, bool isPrefix){
+    size_t n = a.size();
+    size_t m = b.size();
+    if (!isPrefix && (n > m ? n - m : m - n) > static_cast<size_t>(maxDistance)){
+        return maxDistance + 1;
+    }
+    // a prefix of b longer than this can't be within maxDistance of a
+    if (isPrefix){
+        m = min(m, n + maxDistance);
+    }
+
+    // three rows of the dp table, the one two rows back is needed for swaps
+    static thread_local vector<int> twoBack, prev, curr;
+    twoBack.assign(m + 1, 0);
+    prev.resize(m + 1);
+    curr.resize(m + 1);
+    for (size_t j = 0; j <= m; j++){
+        prev[j] = j;
+    }
+
+    for (size_t i = 1; i <= n; i++){
+        curr[0] = i;
+        int rowMin = curr[0];
+        for (size_t j = 1; j <= m; j++){
+            int cost = (a[i-1] == b[j-1]) ? 0 : 1;
+            int best = min({prev[j] + 1, curr[j-1] + 1, prev[j-1] + cost});
+            if (i > 1 && j > 1 && a[i-1] == b[j-2] && a[i-2] == b[j-1]){
+                best = min(best, twoBack[j-2] + 1);
+            }
+            curr[j] = best;
+            rowMin = min(rowMin, best);
+        }
+        // every later row is at least the minimum of this one
+        if (rowMin > maxDistance){
+            return maxDistance + 1;
+        }
+        swap(twoBack, prev);
+        swap(prev, curr);
+    }
+
+    int result = prev[m];
+    if (isPrefix){
+        result = *min_element(prev.begin(), prev.begin() + m + 1);
+    }
+    return min(result, maxDistance + 1);
+}
+
+void FuzzyIndex::build(const Catalog& catalog){
+    *this = FuzzyIndex();
+
+    // one entry per unique (track, artist), keeping the most popular version
+    unordered_map<string, int> entryIds;
+    entryIds.reserve(catalog.size());
+    for (int i = 0; i < catalog.size(); i++){
+        const song_data& song = catalog.song(i);
+        string key = song.track + '\x1f' + song.artist;
+        auto it = entryIds.find(key);
+        if (it == entryIds.end()){
+            entryIds.emplace(key, entrySong.size());
+            entrySong.push_back(i);
+            entryPopularity.push_back(song.popularity);
+        }
+        else if (song.popularity > entryPopularity[it->second]){
+            entrySong[it->second] = i;
+            entryPopularity[it->second] = song.popularity;
+        }
+    }
+
+    // words of every entry and the entries for every word
+    entryWordStart.reserve(entrySong.size() + 1);
+    for (int e = 0; e < entrySong.size(); e++){
+        entryWordStart.push_back(entryWords.size());
+        const song_data& song = catalog.song(entrySong[e]);
+        vector<string> tokens = tokenize(song.track + " " + song.artist);
+        sort(tokens.begin(), tokens.end());
+        tokens.erase(unique(tokens.begin(), tokens.end()), tokens.end());
+        for (const string& token : tokens){
+            auto it = wordIds.find(token);
+            if (it == wordIds.end()){
+                it = wordIds.emplace(token, words.size()).first;
+                words.push_back(token);
+                postings.emplace_back();
+            }
+            entryWords.push_back(it->second);
+            postings[it->second].push_back(e);
+        }
+    }
+    entryWordStart.push_back(entryWords.size());
+
+    // most popular entries first so capped scans still see the best matches
+    vector<int> wordPopularity(words.size());
+    for (int w = 0; w < words.size(); w++){
+        sort(postings[w].begin(), postings[w].end(), [this](int a, int b){
+            return entryPopularity[a] > entryPopularity[b];
+        });
+        wordPopularity[w] = entryPopularity[postings[w][0]];
+    }
+
+    // every prefix of every word, and the deletes of those prefixes
+    for (int w = 0; w < words.size(); w++){
+        size_t longest = min(words[w].size(), PREFIX_LENGTH);
+        for (size_t len = 1; len <= longest; len++){
+            auto it = prefixIds.find(words[w].substr(0, len));
+            if (it == prefixIds.end()){
+                it = prefixIds.emplace(words[w].substr(0, len), prefixWords.size()).first;
+                prefixWords.emplace_back();
+            }
+            prefixWords[it->second].push_back(w);
+        }
+    }
+    vector<string> variants;
+    for (const auto& [prefix, id] : prefixIds){
+        sort(prefixWords[id].begin(), prefixWords[id].end(), [&wordPopularity](int a, int b){
+            return wordPopularity[a] > wordPopularity[b];
+        });
+        if (prefix.size() < 3){
+            continue; // too short to be typo tolerant, only found by exact lookup
+        }
+        generateDeletes(prefix, 2, variants);
+        for (const string& variant : variants){
+            deletes[deleteHash(variant)].push_back(id);
+        }
+    }
+
+    for (size_t slot = 0; slot < MAX_QUERY_WORDS; slot++){
+        wordStamp[slot].assign(words.size(), 0);
+        wordDistance[slot].assign(words.size(), 0);
+    }
+    entryStamp.assign(entrySong.size(), 0);
+}
+
+size_t FuzzyIndex::findWords(const string& query, bool isPrefix, size_t slot){
+    vector<int>& matched = matchedWords[slot];
+    matched.clear();
+    size_t volume = 0;
+
+    auto mark = [&](int word, int distance){
+        wordStamp[slot][word] = stamp;
+        wordDistance[slot][word] = distance;
+        matched.push_back(word);
+        volume += postings[word].size();
+    };
+
+    int edits = maxEdits(query.size());
+    string key = query.substr(0, PREFIX_LENGTH);
+
+    // short words are only matched exactly
+    if (edits == 0){
+        if (isPrefix){
+            auto it = prefixIds.find(key);
+            if (it != prefixIds.end()){
+                for (int word : prefixWords[it->second]){
+                    mark(word, 0);
+                }
+            }
+        }
+        else {
+            auto it = wordIds.find(query);
+            if (it != wordIds.end()){
+                mark(it->second, 0);
+            }
+        }
+        return volume;
+    }
+
+    // returns false once the cap is hit so the caller can stop looking
+    size_t checked = 0;
+    auto check = [&](int word){
+        if (wordStamp[slot][word] == stamp){
+            return true;
+        }
+        if (checked >= MAX_CANDIDATE_WORDS){
+            return false;
+        }
+        checked++;
+        int distance = editDistance(query, words[word], edits, isPrefix);
+        if (distance <= edits){
+            mark(word, distance);
+        }
+        else {
+            wordStamp[slot][word] = stamp;
+            wordDistance[slot][word] = edits + 1; // already checked, not a match
+        }
+        return true;
+    };
+
+    // exact matches first so a cap filled with typo matches can't push them out
+    if (isPrefix){
+        auto it = prefixIds.find(key);
+        if (it != prefixIds.end()){
+            for (int word : prefixWords[it->second]){
+                if (!check(word)){
+                    return volume;
+                }
+            }
+        }
+    }
+    else {
+        auto it = wordIds.find(query);
+        if (it != wordIds.end()){
+            check(it->second);
+        }
+    }
+
+    // then every delete of the typed word, fewest deletes first, checking the words behind each hit
+    static thread_local vector<string> variants;
+    generateDeletes(key, edits, variants);
+    for (const string& variant : variants){
+        auto it = deletes.find(deleteHash(variant));
+        if (it == deletes.end()){
+            continue;
+        }
+        for (int prefix : it->second){
+            for (int word : prefixWords[prefix]){
+                if (!check(word)){
+                    return volume;
+                }
+            }
+        }
+    }
+    return volume;
+}
+
+vector<int> FuzzyIndex::search(const string& input, size_t limit){
+    vector<string> queryWords = tokenize(input);
+    if (queryWords.empty() || words.empty()){
+        return {};
+    }
+    if (queryWords.size() > MAX_QUERY_WORDS){
+        queryWords.resize(MAX_QUERY_WORDS);
+    }
+    // the last word is still being typed unless the input ends with a space or symbol
+    unsigned char lastChar = static_cast<unsigned char>(input.back());
+    bool lastIsPrefix = (lastChar >= 128 || isalnum(lastChar));
+
+    stamp++;
+    size_t driver = 0;
+    size_t driverVolume = SIZE_MAX;
+    for (size_t j = 0; j < queryWords.size(); j++){
+        bool isPrefix = lastIsPrefix && j + 1 == queryWords.size();
+        size_t volume = findWords(queryWords[j], isPrefix, j);
+        if (volume == 0){
+            return {}; // nothing matches this word so nothing can match everything
+        }
+        if (volume < driverVolume){
+            driver = j;
+            driverVolume = volume;
+        }
+    }
+
+    // walk the entries of the word with the fewest entries, closest words first
+    vector<int>& driverWords = matchedWords[driver];
+    sort(driverWords.begin(), driverWords.end(), [this, driver](int a, int b){
+        if (wordDistance[driver][a] != wordDistance[driver][b]){
+            return wordDistance[driver][a] < wordDistance[driver][b];
+        }
+        return entryPopularity[postings[a][0]] > entryPopularity[postings[b][0]];
+    });
+
+    // (total distance, entry), every other word has to match somewhere in the entry too
+    vector<pair<int,int>> found;
+    size_t scanned = 0;
+    for (int word : driverWords){
+        for (int e : postings[word]){
+            if (scanned >= MAX_SCANNED_ENTRIES){
+                break;
+            }
+            if (entryStamp[e] == stamp){
+                continue;
+            }
+            entryStamp[e] = stamp;
+            scanned++;
+
+            int total = 0;
+            for (size_t j = 0; j < queryWords.size() && total >= 0; j++){
+                int best = -1;
+                for (int k = entryWordStart[e]; k < entryWordStart[e + 1]; k++){
+                    int w = entryWords[k];
+                    if (wordStamp[j][w] == stamp && wordDistance[j][w] <= maxEdits(queryWords[j].size())){
+                        if (best < 0 || wordDistance[j][w] < best){
+                            best = wordDistance[j][w];
+                        }
+                    }
+                }
+                total = (best < 0) ? -1 : total + best;
+            }
+            if (total >= 0){
+                found.emplace_back(total, e);
+            }
+        }
+    }
+
+    // fewest typos first, then most popular
+    size_t count = min(limit, found.size());
+    partial_sort(found.begin(), found.begin() + count, found.end(), [this](const pair<int,int>& a, const pair<int,int>& b){
+        if (a.first != b.first){
+            return a.first < b.first;
+        }
+        return entryPopularity[a.second] > entryPopularity[b.second];
+    });
+
+    vector<int> results;
+    for (size_t i = 0; i < count; i++){
+        results.push_back(entrySong[found[i].second]);
+    }
+    return results;
+}
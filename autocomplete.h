@@ -0,0 +1,75 @@
+// typo tolerant autocomplete for the search box
+#pragma once
+#include <cstdint>
+#include "catalog.h"
+
+/*
+Fuzzy index over the words in every track name and artist (symspell style).
+Each word is split into its prefixes (up to PREFIX_LENGTH characters), and every prefix is stored
+together with all the strings you get by deleting up to 2 characters from it.
+A typed word is turned into its deletes the same way, so finding all words within a couple
+of typos is a handful of hash lookups instead of comparing against the whole catalog.
+The last typed word is matched as a prefix since the user is probably still typing it.
+*/
+class FuzzyIndex {
+public:
+    // builds the index, songs are referred to by their global index in the catalog
+    void build(const Catalog& catalog);
+
+    /*
+    returns up to limit song indices whose track/artist words match every word in the input,
+    ranked by total edit distance first and popularity second.
+    only one song is returned per (track, artist) pair, the most popular one
+    */
+    std::vector<int> search(const std::string& input, size_t limit);
+
+private:
+    // a word this long or longer is matched on its first PREFIX_LENGTH characters
+    static constexpr size_t PREFIX_LENGTH = 7;
+    // keeps each keystroke bounded no matter how big the catalog is
+    static constexpr size_t MAX_CANDIDATE_WORDS = 2000;
+    static constexpr size_t MAX_SCANNED_ENTRIES = 50000;
+    static constexpr size_t MAX_QUERY_WORDS = 8;
+
+    // one entry per unique (track, artist) pair
+    std::vector<int> entrySong;
+    std::vector<int> entryPopularity;
+    std::vector<int> entryWordStart; // words of entry e are entryWords[entryWordStart[e] .. entryWordStart[e+1])
+    std::vector<int> entryWords;
+
+    // the vocabulary, postings are entry ids sorted by popularity
+    std::unordered_map<std::string, int> wordIds;
+    std::vector<std::string> words;
+    std::vector<std::vector<int>> postings;
+
+    // distinct word prefixes, each with the words that start with it (most popular first)
+    std::unordered_map<std::string, int> prefixIds;
+    std::vector<std::vector<int>> prefixWords;
+
+    // hash of a delete variant -> prefixes that produce it
+    std::unordered_map<uint64_t, std::vector<int>> deletes;
+
+    // scratch space reused between keystrokes, the stamps avoid clearing the arrays
+    int stamp = 0;
+    std::vector<int> wordStamp[MAX_QUERY_WORDS];
+    std::vector<int> wordDistance[MAX_QUERY_WORDS];
+    std::vector<int> matchedWords[MAX_QUERY_WORDS];
+    std::vector<int> entryStamp;
+
+    /*
+    finds the words within the allowed edits of query (matched as a prefix if isPrefix)
+    and fills in matchedWords, wordStamp and wordDistance for that slot.
+    returns how many entries contain one of the matched words
+    */
+    size_t findWords(const std::string& query, bool isPrefix, size_t slot);
+};
+
+// splits text into lowercase words, anything that isn't a letter or digit separates words
+std::vector<std::string> tokenize(const std::string& text);
+
+/*
+Optimal string alignment distance (levenshtein plus swapping two neighbouring letters).
+Gives up and returns maxDistance + 1 as soon as the distance can't be maxDistance or less.
+If isPrefix is set, returns the distance between a and the closest prefix of b
+*/
+int editDistance(const std::string& a, const std::string& b, int maxDistance, bool isPrefix);
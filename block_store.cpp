@@ -0,0 +1,433 @@
+#include "block_store.h"
+#include "kNN.h"
+#include "rNN.h"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+static const char BLOCK_STORE_MAGIC[8] = {'M', 'M', 'B', 'L', 'O', 'C', 'K', '3'};
+
+// songs sorted along the curve together before being cut into blocks
+const size_t CHUNK_SONGS = 64 * BLOCK_SONGS;
+
+// bytes of one block, the feature columns then the track hashes and the csv rows
+const size_t BLOCK_BYTES = BLOCK_SONGS * (NUM_FEATURES * sizeof(double) + sizeof(uint64_t) + sizeof(int32_t));
+
+MappedFile::MappedFile(const filesystem::path& path){
+#ifdef _WIN32
+    file = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE){
+        file = nullptr;
+        throw runtime_error("Failed to open file " + path.string());
+    }
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    length = static_cast<size_t>(fileSize.QuadPart);
+    if (length == 0){
+        return;
+    }
+    mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping){
+        throw runtime_error("Failed to map file " + path.string());
+    }
+    base = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!base){
+        throw runtime_error("Failed to map file " + path.string());
+    }
+#else
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0){
+        throw runtime_error("Failed to open file " + path.string());
+    }
+    struct stat info;
+    fstat(fd, &info);
+    length = static_cast<size_t>(info.st_size);
+    if (length == 0){
+        return;
+    }
+    void* memory = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED){
+        close(fd);
+        fd = -1;
+        throw runtime_error("Failed to map file " + path.string());
+    }
+    base = static_cast<const char*>(memory);
+#endif
+}
+
+MappedFile::~MappedFile(){
+#ifdef _WIN32
+    if (base) UnmapViewOfFile(base);
+    if (mapping) CloseHandle(mapping);
+    if (file) CloseHandle(file);
+#else
+    if (base) munmap(const_cast<char*>(base), length);
+    if (fd >= 0) close(fd);
+#endif
+}
+
+void MappedFile::adviseRandom(size_t from, size_t bytes){
+#ifndef _WIN32
+    // madvise only takes whole pages, the partial page at the start keeps its readahead
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t begin = (from + page - 1) / page * page;
+    size_t end = min(from + bytes, length);
+    if (base && begin < end){
+        madvise(const_cast<char*>(base) + begin, end - begin, MADV_RANDOM);
+    }
+#endif
+}
+
+uint64_t trackHash(const string& track){
+    // 64 bit fnv-1a, a clash is unlikely even with every track name of a huge catalog
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : track){
+        hash = (hash ^ c) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// calls onSong for every usable row of a csv, read through a mapping so it never has to fit in memory
+static void scanSongs(const filesystem::path& path, const function<void(const song_data&)>& onSong){
+    MappedFile csv(path);
+    const char* headerEnd = static_cast<const char*>(memchr(csv.data(), '\n', csv.size()));
+    if (!headerEnd){
+        return;
+    }
+    size_t skip = headerEnd + 1 - csv.data();
+    scanCsvSpans(csv.data() + skip, csv.size() - skip, [&](const FieldSpan* row, size_t count){
+        if (count < 21){
+            return; // blank or broken line, same as loadFile
+        }
+        onSong(song_data(row));
+    });
+}
+
+static size_t roundUp(size_t n, size_t to){
+    return (n + to - 1) / to * to;
+}
+
+void writeBlockStore(const vector<filesystem::path>& csvPaths, const filesystem::path& out,
+                     ScalingMode mode, SongOrder order){
+    if (mode == ScalingMode::Robust){
+        throw invalid_argument("robust scaling needs every value in memory");
+    }
+    ofstream file(out, ios::binary | ios::trunc);
+    if (!file){
+        throw runtime_error("Failed to open file " + out.string());
+    }
+
+    // first pass: the stats for the scaling, and the names go straight into the file after the header
+    BlockStoreHeader header = {};
+    memcpy(header.magic, BLOCK_STORE_MAGIC, sizeof(header.magic));
+    header.blockSongs = BLOCK_SONGS;
+    header.mode = static_cast<uint32_t>(mode);
+    header.namesAt = roundUp(sizeof(BlockStoreHeader), 64);
+    FeatureMatrix scaling;
+    uint64_t nameBytes = 0;
+    vector<TrackLookup> lookup;
+    file.seekp(header.namesAt);
+    for (const auto& path : csvPaths){
+        scanSongs(path, [&](const song_data& song){
+            double raw[NUM_FEATURES];
+            song.rawFeatures(raw);
+            for (int c = 0; c < NUM_FEATURES; c++){
+                scaling.stats[c].add(raw[c]);
+            }
+            file.write(song.track.c_str(), song.track.size() + 1);
+            file.write(song.artist.c_str(), song.artist.size() + 1);
+            nameBytes += song.track.size() + song.artist.size() + 2;
+            lookup.push_back({trackHash(song.track), header.songCount});
+            header.songCount++;
+        });
+    }
+    shareScaling({&scaling}, mode);
+    copy(scaling.offset, scaling.offset + NUM_FEATURES, header.offset);
+    copy(scaling.scale, scaling.scale + NUM_FEATURES, header.scale);
+    header.blockCount = (header.songCount + BLOCK_SONGS - 1) / BLOCK_SONGS;
+    header.offsetsAt = roundUp(header.namesAt + nameBytes, 8);
+    header.slotsAt = roundUp(header.offsetsAt + (header.songCount + 1) * sizeof(uint64_t), 8);
+    header.lookupAt = roundUp(header.slotsAt + header.songCount * sizeof(uint32_t), 8);
+    header.zonesAt = roundUp(header.lookupAt + header.songCount * sizeof(TrackLookup), 64);
+
+    // the rows went in in order, so sorting by hash keeps the versions of a track in row order
+    stable_sort(lookup.begin(), lookup.end(), [](const TrackLookup& a, const TrackLookup& b){
+        return a.hash < b.hash;
+    });
+    file.seekp(header.lookupAt);
+    file.write(reinterpret_cast<const char*>(lookup.data()), lookup.size() * sizeof(TrackLookup));
+    lookup = vector<TrackLookup>(); // not needed for the blocks
+    header.blocksAt = roundUp(header.zonesAt + header.blockCount * sizeof(FeatureBox), 4096);
+
+    // the curve covers the scaled range of the whole catalog, the same as Catalog::loadFiles
+    double low[NUM_FEATURES], high[NUM_FEATURES];
+    for (int c = 0; c < NUM_FEATURES; c++){
+        low[c] = (scaling.stats[c].min - scaling.offset[c]) / scaling.scale[c];
+        high[c] = (scaling.stats[c].max - scaling.offset[c]) / scaling.scale[c];
+    }
+
+    // second pass: one chunk of songs at a time, sorted along the curve and written out as blocks
+    vector<FeatureBox> zones;
+    zones.reserve(header.blockCount);
+    FeatureMatrix chunk;
+    chunk.values.reserve(CHUNK_SONGS * NUM_FEATURES);
+    copy(scaling.offset, scaling.offset + NUM_FEATURES, chunk.offset);
+    copy(scaling.scale, scaling.scale + NUM_FEATURES, chunk.scale);
+    vector<uint64_t> hashes;
+    vector<int32_t> rows;
+    vector<uint32_t> slots;
+    vector<uint64_t> nameOffsets;
+    vector<char> block(BLOCK_BYTES);
+    uint64_t nameOffset = 0;
+    int32_t row = 0;
+
+    auto flush = [&](){
+        if (rows.empty()){
+            return;
+        }
+        // the name offsets of this chunk are for consecutive rows so they go out in one write
+        file.seekp(header.offsetsAt + (rows.front()) * sizeof(uint64_t));
+        file.write(reinterpret_cast<const char*>(nameOffsets.data()), nameOffsets.size() * sizeof(uint64_t));
+        nameOffsets.clear();
+
+        chunk.applyScaling();
+        vector<int> sorted = curveOrder(chunk, low, high, order);
+        slots.resize(rows.size());
+        for (size_t i = 0; i < sorted.size(); i++){
+            slots[sorted[i]] = static_cast<uint32_t>(zones.size() * BLOCK_SONGS + i);
+        }
+        file.seekp(header.slotsAt + rows.front() * sizeof(uint32_t));
+        file.write(reinterpret_cast<const char*>(slots.data()), slots.size() * sizeof(uint32_t));
+
+        file.seekp(header.blocksAt + zones.size() * BLOCK_BYTES);
+        for (size_t begin = 0; begin < sorted.size(); begin += BLOCK_SONGS){
+            size_t count = min<size_t>(BLOCK_SONGS, sorted.size() - begin);
+            fill(block.begin(), block.end(), 0);
+            double* columns = reinterpret_cast<double*>(block.data());
+            uint64_t* blockHashes = reinterpret_cast<uint64_t*>(columns + NUM_FEATURES * BLOCK_SONGS);
+            int32_t* blockRows = reinterpret_cast<int32_t*>(blockHashes + BLOCK_SONGS);
+            FeatureBox zone = emptyBox();
+            for (size_t i = 0; i < count; i++){
+                int song = sorted[begin + i];
+                const double* features = chunk.row(song);
+                for (int c = 0; c < NUM_FEATURES; c++){
+                    columns[c * BLOCK_SONGS + i] = features[c];
+                }
+                growBox(zone, features, features);
+                blockHashes[i] = hashes[song];
+                blockRows[i] = rows[song];
+            }
+            zones.push_back(zone);
+            file.write(block.data(), block.size());
+        }
+        chunk.values.clear();
+        hashes.clear();
+        rows.clear();
+    };
+
+    for (const auto& path : csvPaths){
+        scanSongs(path, [&](const song_data& song){
+            double raw[NUM_FEATURES];
+            song.rawFeatures(raw);
+            chunk.values.insert(chunk.values.end(), raw, raw + NUM_FEATURES);
+            hashes.push_back(trackHash(song.track));
+            rows.push_back(row++);
+            nameOffsets.push_back(nameOffset);
+            nameOffset += song.track.size() + song.artist.size() + 2;
+            // a chunk is a whole number of blocks so only the very last block is ever partial
+            if (rows.size() == CHUNK_SONGS){
+                flush();
+            }
+        });
+    }
+    flush();
+
+    file.seekp(header.offsetsAt + header.songCount * sizeof(uint64_t));
+    file.write(reinterpret_cast<const char*>(&nameOffset), sizeof(nameOffset));
+    file.seekp(header.zonesAt);
+    file.write(reinterpret_cast<const char*>(zones.data()), zones.size() * sizeof(FeatureBox));
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!file){
+        throw runtime_error("Failed to write file " + out.string());
+    }
+}
+
+BlockStore::BlockStore(const filesystem::path& path) : file(path) {
+    header = reinterpret_cast<const BlockStoreHeader*>(file.data());
+    if (file.size() < sizeof(BlockStoreHeader) || memcmp(header->magic, BLOCK_STORE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->blockSongs != BLOCK_SONGS || file.size() < header->blocksAt + header->blockCount * BLOCK_BYTES){
+        throw runtime_error("Not a block store " + path.string());
+    }
+    zones = reinterpret_cast<const FeatureBox*>(file.data() + header->zonesAt);
+    slots = reinterpret_cast<const uint32_t*>(file.data() + header->slotsAt);
+    lookup = reinterpret_cast<const TrackLookup*>(file.data() + header->lookupAt);
+    // the zone maps decide which blocks get read, reading ahead there would just pull in skipped ones
+    file.adviseRandom(header->blocksAt, header->blockCount * BLOCK_BYTES);
+}
+
+void BlockStore::scaleFeatures(const double* raw, double* scaled) const {
+    for (int c = 0; c < NUM_FEATURES; c++){
+        scaled[c] = (raw[c] - header->offset[c]) / header->scale[c];
+    }
+}
+
+void BlockStore::name(int row, string& track, string& artist) const {
+    const uint64_t* offsets = reinterpret_cast<const uint64_t*>(file.data() + header->offsetsAt);
+    const char* entry = file.data() + header->namesAt + offsets[row];
+    track.assign(entry);
+    artist.assign(entry + track.size() + 1);
+}
+
+string_view BlockStore::artistOf(int row) const {
+    const uint64_t* offsets = reinterpret_cast<const uint64_t*>(file.data() + header->offsetsAt);
+    const char* entry = file.data() + header->namesAt + offsets[row];
+    return string_view(entry + strlen(entry) + 1);
+}
+
+int BlockStore::find(const string& track, const string& artist) const {
+    // every version of the track is in one run of the lookup, in row order
+    uint64_t hash = trackHash(track);
+    const TrackLookup* end = lookup + header->songCount;
+    const TrackLookup* it = lower_bound(lookup, end, hash, [](const TrackLookup& entry, uint64_t h){
+        return entry.hash < h;
+    });
+    const uint64_t* offsets = reinterpret_cast<const uint64_t*>(file.data() + header->offsetsAt);
+    int first = -1;
+    for (; it != end && it->hash == hash; ++it){
+        // the name is checked as well in case another track has the same hash
+        const char* entry = file.data() + header->namesAt + offsets[it->row];
+        string_view entryTrack(entry);
+        if (entryTrack != track){
+            continue;
+        }
+        if (string_view(entry + entryTrack.size() + 1) == artist){
+            return it->row;
+        }
+        if (first < 0){
+            first = it->row;
+        }
+    }
+    return first;
+}
+
+const char* BlockStore::block(size_t b) const {
+    return file.data() + header->blocksAt + b * BLOCK_BYTES;
+}
+
+void BlockStore::features(int row, double* out) const {
+    uint32_t slot = slots[row];
+    const double* columns = reinterpret_cast<const double*>(block(slot / BLOCK_SONGS));
+    for (int c = 0; c < NUM_FEATURES; c++){
+        out[c] = columns[c * BLOCK_SONGS + slot % BLOCK_SONGS];
+    }
+}
+
+void BlockStore::search(const double* target, Skip skip, TopK& best){
+    ArenaScope scope;
+    scanned = 0;
+    uint64_t skipHash = 0;
+    string_view skipArtist;
+    if (skip.row >= 0){
+        uint32_t slot = slots[skip.row];
+        const double* columns = reinterpret_cast<const double*>(block(slot / BLOCK_SONGS));
+        skipHash = reinterpret_cast<const uint64_t*>(columns + NUM_FEATURES * BLOCK_SONGS)[slot % BLOCK_SONGS];
+        skipArtist = artistOf(skip.row);
+    }
+
+    // only blocks whose box reaches inside the bound are worth reading, closest first
+    pmr::vector<pair<double,uint32_t>> candidates(scope.resource());
+    candidates.reserve(header->blockCount);
+    for (uint32_t b = 0; b < header->blockCount; b++){
+        double gap = boxDistanceSquare(zones[b], target);
+        if (gap < best.bound()){
+            candidates.emplace_back(gap, b);
+        }
+    }
+    sort(candidates.begin(), candidates.end());
+
+    double distSquare[BLOCK_SONGS];
+    for (const auto& [gap, b] : candidates){
+        if (gap >= best.bound()){
+            break;
+        }
+        scanned++;
+        size_t count = min<size_t>(BLOCK_SONGS, header->songCount - size_t(b) * BLOCK_SONGS);
+        const double* columns = reinterpret_cast<const double*>(block(b));
+        const uint64_t* hashes = reinterpret_cast<const uint64_t*>(columns + NUM_FEATURES * BLOCK_SONGS);
+        const int32_t* rows = reinterpret_cast<const int32_t*>(hashes + BLOCK_SONGS);
+
+        // a column at a time so the inner loop runs down contiguous doubles
+        fill(distSquare, distSquare + count, 0.0);
+        for (int c = 0; c < NUM_FEATURES; c++){
+            const double* column = columns + c * BLOCK_SONGS;
+            double t = target[c];
+            for (size_t i = 0; i < count; i++){
+                double diff = column[i] - t;
+                distSquare[i] += diff * diff;
+            }
+        }
+        for (size_t i = 0; i < count; i++){
+            if (distSquare[i] >= best.bound()){
+                continue;
+            }
+            // versions of the search song are left out the same way kNN and rNN do it
+            if (skip.row >= 0 && hashes[i] == skipHash && (!skip.byArtist || artistOf(rows[i]) == skipArtist)){
+                continue;
+            }
+            best.offer({rows[i], static_cast<int64_t>(hashes[i]), distSquare[i]});
+        }
+    }
+}
+
+void BlockStore::radius(int row, double r, vector<SongResult>& results){
+    if (static_cast<ScalingMode>(header->mode) != ScalingMode::MinMax){
+        throw logic_error("radius searches need MinMax scaling");
+    }
+    results.clear();
+    ArenaScope scope;
+    double target[NUM_FEATURES];
+    features(row, target);
+    TopK best(10, r * r, scope.resource());
+    search(target, {row, true}, best);
+    if (best.items.size() < 10){
+        return;
+    }
+    for (const auto& n : best.items){
+        results.emplace_back(n.index, getPercentSim(sqrt(n.distSquare)));
+    }
+}
+
+void BlockStore::kNearest(int k, int row, vector<SongResult>& results){
+    results.clear();
+    ArenaScope scope;
+    double target[NUM_FEATURES];
+    features(row, target);
+    TopK best(k, numeric_limits<double>::infinity(), scope.resource());
+    search(target, {row, false}, best);
+    for (const auto& n : best.items){
+        results.emplace_back(n.index, getInverseSim(sqrt(n.distSquare)));
+    }
+}
+
+void BlockStore::kNearestTo(int k, const double* target, vector<SongResult>& results){
+    results.clear();
+    ArenaScope scope;
+    TopK best(k, numeric_limits<double>::infinity(), scope.resource());
+    search(target, Skip(), best);
+    for (const auto& n : best.items){
+        results.emplace_back(n.index, getInverseSim(sqrt(n.distSquare)));
+    }
+}
@@ -0,0 +1,153 @@
+// on disk columnar store of the scaled features, for catalogs too big to keep in memory
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <filesystem>
+#include "catalog.h"
+
+/*
+Read only memory mapping of a whole file (mmap, or a file mapping on windows).
+Pages are only read from disk when they are touched
+*/
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::filesystem::path& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return base; }
+    size_t size() const { return length; }
+
+    // tells the os not to read ahead in bytes from .. from + bytes - 1, for parts that are jumped around in
+    void adviseRandom(size_t from, size_t bytes);
+
+private:
+    const char* base = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void* file = nullptr;
+    void* mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+// songs per block, every block has its own zone map
+const uint32_t BLOCK_SONGS = 1024;
+
+// one entry of the lookup section
+struct TrackLookup {
+    uint64_t hash; // trackHash of the song's track name
+    uint64_t row;
+};
+
+/*
+Start of a block store file. The file is laid out as
+header | names | name offsets | row slots | lookup | zone maps | blocks
+names     - "track\0artist\0" for every song in csv row order, offsets[row] is where each one starts
+row slots - where each csv row ended up, block * BLOCK_SONGS + position in the block
+lookup    - a TrackLookup for every song sorted by hash then row, so a track name is a binary search away
+zone maps - one FeatureBox per block, small enough to always scan all of them
+blocks    - NUM_FEATURES columns of BLOCK_SONGS doubles, then the track hash and csv row of each song.
+            the last block is padded with zeros
+*/
+struct BlockStoreHeader {
+    char magic[8];
+    uint32_t blockSongs;
+    uint32_t mode; // ScalingMode the features were scaled with
+    uint64_t songCount;
+    uint64_t blockCount;
+    uint64_t namesAt;
+    uint64_t offsetsAt;
+    uint64_t slotsAt;
+    uint64_t lookupAt;
+    uint64_t zonesAt;
+    uint64_t blocksAt;
+    double offset[NUM_FEATURES];
+    double scale[NUM_FEATURES];
+};
+
+// 64 bit hash of a track name, the block store uses it instead of catalog wide track ids to tell tracks apart
+uint64_t trackHash(const std::string& track);
+
+/*
+Writes the songs of the csv files into one block store at out, streaming so the csvs can be bigger than memory
+(only the lookup entry of each song is held until it is written).
+The csvs are read twice (stats and names, then the blocks) and each chunk of songs is sorted along the
+curve before it is cut into blocks so their zone maps stay small.
+Rows are numbered across all the files in order, the same as the global indices of Catalog::loadFiles.
+Robust scaling needs every value at once so it isn't supported (throws invalid_argument)
+*/
+void writeBlockStore(const std::vector<std::filesystem::path>& csvPaths, const std::filesystem::path& out,
+                     ScalingMode mode = ScalingMode::MinMax, SongOrder order = SongOrder::Hilbert);
+
+/*
+Searches a block store without loading it. Only the zone maps are read for every query,
+blocks whose bounding box can't hold anything closer than the current kth best (or outside the radius)
+are never touched, so the disk reads follow the part of the feature space that is searched.
+Blocks are visited closest box first so that bound shrinks quickly.
+Songs are referred to by csv row (the same as the global indices of Catalog::loadFiles),
+the row slots find a song's block so searching from a song doesn't need the catalog in memory
+*/
+class BlockStore {
+public:
+    // throws runtime_error if the file can't be opened or isn't a block store
+    explicit BlockStore(const std::filesystem::path& path);
+
+    size_t size() const { return header->songCount; }
+    size_t blockCount() const { return header->blockCount; }
+
+    // maps raw feature values (csv units) into the scaled space of the store
+    void scaleFeatures(const double* raw, double* scaled) const;
+
+    // track name and artist of the song in a csv row
+    void name(int row, std::string& track, std::string& artist) const;
+
+    /*
+    csv row of the song with this track name and artist, or its first version if the artist is empty or
+    doesn't match (like the app's search box). -1 if there is no such track.
+    binary searches the lookup section, only the names of the track's versions are read
+    */
+    int find(const std::string& track, const std::string& artist) const;
+
+    // scaled features of the song in a csv row, only its own block is read
+    void features(int row, double* out) const;
+
+    // the k nearest songs to the song in a csv row like Catalog::kNearest, every version of its track is left out
+    void kNearest(int k, int row, std::vector<SongResult>& results);
+
+    // the 10 closest songs within radius r of the song in a csv row like Catalog::radius
+    // (only the same track by the same artist is left out), empty if fewer than 10 are in range.
+    // needs a store written with MinMax scaling (throws logic_error otherwise, see ScalingMode)
+    void radius(int row, double r, std::vector<SongResult>& results);
+
+    // the k nearest songs to a point of the scaled space like Catalog::kNearestTo, nothing is left out
+    void kNearestTo(int k, const double* target, std::vector<SongResult>& results);
+
+    // how many blocks the last search had to read
+    size_t blocksScanned() const { return scanned; }
+
+private:
+    MappedFile file;
+    const BlockStoreHeader* header;
+    const FeatureBox* zones;
+    const uint32_t* slots;
+    const TrackLookup* lookup;
+    size_t scanned = 0;
+
+    // the song a search starts from, and which of its versions are left out
+    struct Skip {
+        int row = -1;          // -1 to leave nothing out
+        bool byArtist = false; // only the version by the same artist (radius) instead of every version (kNN)
+    };
+
+    const char* block(size_t b) const;
+    std::string_view artistOf(int row) const;
+
+    // scans the blocks that could still have something under best's bound
+    void search(const double* target, Skip skip, TopK& best);
+};
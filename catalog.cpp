@@ -0,0 +1,385 @@
+#include "catalog.h"
+#include "kNN.h"
+#include "rNN.h"
+#include "multi_seed.h"
+using namespace std;
+
+ShardPool::ShardPool(int threads){
+    for (int i = 0; i < threads; i++){
+        workers.emplace_back([this]{ workerLoop(); });
+    }
+}
+
+ShardPool::~ShardPool(){
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers){
+        worker.join();
+    }
+}
+
+void ShardPool::drainTasks(void* context, void (*function)(void*, int), int count){
+    for (int i = nextTask++; i < count; i = nextTask++){
+        function(context, i);
+    }
+}
+
+// only ever called from one thread at a time (the ui thread)
+void ShardPool::runTasks(int count, void* context, void (*function)(void*, int)){
+    // not worth waking anyone up
+    if (workers.empty() || count <= 1){
+        for (int i = 0; i < count; i++){
+            function(context, i);
+        }
+        return;
+    }
+
+    {
+        lock_guard<mutex> guard(lock);
+        taskContext = context;
+        taskFunction = function;
+        taskCount = count;
+        nextTask = 0;
+        running = workers.size();
+        generation++;
+    }
+    wake.notify_all();
+
+    drainTasks(context, function, count);
+
+    unique_lock<mutex> guard(lock);
+    finished.wait(guard, [this]{ return running == 0; });
+}
+
+void ShardPool::workerLoop(){
+    int seenGeneration = 0;
+    while (true){
+        void* context;
+        void (*function)(void*, int);
+        int count;
+        {
+            unique_lock<mutex> guard(lock);
+            wake.wait(guard, [&]{ return stopping || generation != seenGeneration; });
+            if (stopping){
+                return;
+            }
+            seenGeneration = generation;
+            context = taskContext;
+            function = taskFunction;
+            count = taskCount;
+        }
+
+        drainTasks(context, function, count);
+
+        {
+            lock_guard<mutex> guard(lock);
+            running--;
+        }
+        finished.notify_one();
+    }
+}
+
+vector<filesystem::path> datasetFiles(const string& exePath){
+    // the shard files sit next to the executable like dataset.csv always has
+    filesystem::path directory = filesystem::path(exePath).parent_path();
+    if (directory.empty()){
+        directory = ".";
+    }
+    vector<filesystem::path> paths;
+    for (const auto& entry : filesystem::directory_iterator(directory)){
+        string name = entry.path().filename().string();
+        bool isShard = name == "dataset.csv" ||
+                       (name.rfind("dataset_", 0) == 0 && entry.path().extension() == ".csv");
+        if (entry.is_regular_file() && isShard){
+            paths.push_back(entry.path());
+        }
+    }
+    if (paths.empty()){
+        throw runtime_error("Failed to open file");
+    }
+    sort(paths.begin(), paths.end());
+    return paths;
+}
+
+void Catalog::load(const string& exePath, ScalingMode mode, SongOrder order){
+    loadFiles(datasetFiles(exePath), mode, order);
+}
+
+// stores the songs and features of a shard in the given order of file rows
+static void reorderShard(Shard& shard, vector<int> order){
+    vector<song_data> songs;
+    songs.reserve(order.size());
+    vector<double> values(shard.features.values.size());
+    shard.positions.resize(order.size());
+    for (int i = 0; i < order.size(); i++){
+        songs.push_back(move(shard.songs[order[i]]));
+        const double* row = shard.features.row(order[i]);
+        copy(row, row + NUM_FEATURES, values.begin() + i * NUM_FEATURES);
+        shard.positions[order[i]] = i;
+    }
+    shard.songs = move(songs);
+    shard.features.values = move(values);
+    shard.rows = move(order);
+}
+
+FeatureBox emptyBox(){
+    FeatureBox box;
+    fill(box.min, box.min + NUM_FEATURES, numeric_limits<double>::infinity());
+    fill(box.max, box.max + NUM_FEATURES, -numeric_limits<double>::infinity());
+    return box;
+}
+
+void growBox(FeatureBox& box, const double* min, const double* max){
+    for (int c = 0; c < NUM_FEATURES; c++){
+        box.min[c] = std::min(box.min[c], min[c]);
+        box.max[c] = std::max(box.max[c], max[c]);
+    }
+}
+
+double boxDistanceSquare(const FeatureBox& box, const double* point){
+    double sum = 0;
+    for (int c = 0; c < NUM_FEATURES; c++){
+        double gap = max({0.0, box.min[c] - point[c], point[c] - box.max[c]});
+        sum += gap * gap;
+    }
+    return sum;
+}
+
+// bounding boxes of runs of stored songs, searches that can rule out a whole box use them to skip its songs
+static void computeBoxes(Shard& shard){
+    size_t count = shard.songs.size();
+    shard.boxes.assign((count + SHARD_BOX_SONGS - 1) / SHARD_BOX_SONGS, emptyBox());
+    for (size_t i = 0; i < count; i++){
+        const double* row = shard.features.row(i);
+        growBox(shard.boxes[i / SHARD_BOX_SONGS], row, row);
+    }
+    shard.superBoxes.assign((shard.boxes.size() + SUPER_BOX_BOXES - 1) / SUPER_BOX_BOXES, emptyBox());
+    for (size_t b = 0; b < shard.boxes.size(); b++){
+        growBox(shard.superBoxes[b / SUPER_BOX_BOXES], shard.boxes[b].min, shard.boxes[b].max);
+    }
+}
+
+void Catalog::loadFiles(const vector<filesystem::path>& paths, ScalingMode mode, SongOrder order){
+    if (paths.empty()){
+        throw runtime_error("No files to load");
+    }
+    if (!workers){
+        int threads = max(1u, thread::hardware_concurrency());
+        workers = make_unique<ShardPool>(threads - 1);
+    }
+
+    // parse every file at the same time, each shard only gathers its own stats
+    shards.assign(paths.size(), Shard());
+    vector<exception_ptr> errors(paths.size());
+    auto parse = [&](int i){
+        try {
+            shards[i].source = paths[i].string();
+            shards[i].songs = loadFile(paths[i], shards[i].features);
+        } catch (...) {
+            errors[i] = current_exception();
+        }
+    };
+    pool().run(paths.size(), parse);
+    for (auto& error : errors){
+        if (error){
+            rethrow_exception(error);
+        }
+    }
+
+    totalSongs = 0;
+    vector<FeatureMatrix*> parts;
+    for (auto& shard : shards){
+        shard.offset = totalSongs;
+        totalSongs += shard.songs.size();
+        parts.push_back(&shard.features);
+    }
+
+    // one global min/max (or mean/stddev) so distances mean the same thing in every shard
+    shareScaling(parts, mode);
+
+    // the curve is laid over the global bounds so every shard is cut up the same way
+    const FeatureMatrix& scaling = shards.front().features;
+    double low[NUM_FEATURES], high[NUM_FEATURES];
+    for (int c = 0; c < NUM_FEATURES; c++){
+        low[c] = (scaling.stats[c].min - scaling.offset[c]) / scaling.scale[c];
+        high[c] = (scaling.stats[c].max - scaling.offset[c]) / scaling.scale[c];
+    }
+    auto rescale = [&](int i){
+        shards[i].features.applyScaling();
+        reorderShard(shards[i], curveOrder(shards[i].features, low, high, order));
+        computeBoxes(shards[i]);
+    };
+    pool().run(shards.size(), rescale);
+
+    // give every track name one id across all shards so duplicates can be skipped with an int compare
+    unordered_map<string,int> ids;
+    ids.reserve(totalSongs);
+    for (auto& shard : shards){
+        shard.trackIds.resize(shard.songs.size());
+        for (int i = 0; i < shard.songs.size(); i++){
+            shard.trackIds[i] = ids.emplace(shard.songs[i].track, ids.size()).first->second;
+        }
+    }
+}
+
+const Shard& Catalog::shardOf(int index) const {
+    auto it = upper_bound(shards.begin(), shards.end(), index,
+                          [](int i, const Shard& shard){ return i < shard.offset; });
+    return *(it - 1);
+}
+
+const song_data& Catalog::song(int index) const {
+    const Shard& shard = shardOf(index);
+    return shard.songs[shard.positions[index - shard.offset]];
+}
+
+const double* Catalog::featureRow(int index) const {
+    const Shard& shard = shardOf(index);
+    return shard.features.row(shard.positions[index - shard.offset]);
+}
+
+int Catalog::trackId(int index) const {
+    const Shard& shard = shardOf(index);
+    return shard.trackIds[shard.positions[index - shard.offset]];
+}
+
+// combines the per shard lists, TopK drops the duplicates across shards
+static void mergeShards(const pmr::vector<TopK>& perShard, TopK& merged){
+    for (const auto& best : perShard){
+        for (const auto& n : best.items){
+            merged.offer(n);
+        }
+    }
+}
+
+void Catalog::scaleFeatures(const double* raw, double* scaled) const {
+    const FeatureMatrix& features = shards.front().features;
+    for (int c = 0; c < NUM_FEATURES; c++){
+        scaled[c] = (raw[c] - features.offset[c]) / features.scale[c];
+    }
+}
+
+void Catalog::nearest(int k, const double* target, int skipTrack, vector<SongResult>& results){
+    results.clear();
+    ArenaScope scope;
+
+    // every shard finds its own k nearest, then the lists are merged
+    pmr::vector<TopK> perShard(scope.resource());
+    perShard.reserve(shards.size());
+    for (size_t i = 0; i < shards.size(); i++){
+        perShard.emplace_back(k, numeric_limits<double>::infinity(), scope.resource());
+    }
+    auto searchShard = [&](int i){ kNearestNeighbors(shards[i], target, skipTrack, perShard[i]); };
+    pool().run(shards.size(), searchShard);
+
+    TopK merged(k, numeric_limits<double>::infinity(), scope.resource());
+    mergeShards(perShard, merged);
+    for (const auto& n : merged.items){
+        results.emplace_back(n.index, getInverseSim(sqrt(n.distSquare)));
+    }
+}
+
+void Catalog::kNearest(int k, int index, vector<SongResult>& results){
+    nearest(k, featureRow(index), trackId(index), results);
+}
+
+void Catalog::kNearestTo(int k, const double* target, vector<SongResult>& results){
+    nearest(k, target, -1, results);
+}
+
+void Catalog::kNearestMulti(int k, const vector<int>& seeds, const vector<double>& weights,
+                            SeedAggregate aggregate, vector<SongResult>& results){
+    results.clear();
+    if (seeds.empty()){
+        return;
+    }
+    ArenaScope scope;
+
+    // the bounds are worked out once here, then every shard is scanned once for all the seeds
+    SeedQuery query(scope.resource());
+    query.prepare(*this, seeds, weights, aggregate);
+
+    // the workers' scratch comes from this thread's arena as well, so they never allocate
+    pmr::vector<TopK> perShard(scope.resource());
+    pmr::vector<SeedScratch> scratch(scope.resource());
+    perShard.reserve(shards.size());
+    scratch.reserve(shards.size());
+    for (size_t i = 0; i < shards.size(); i++){
+        perShard.emplace_back(k, numeric_limits<double>::infinity(), scope.resource());
+        scratch.emplace_back(query, shards[i], scope.resource());
+    }
+    auto searchShard = [&](int i){ multiSeedNearest(shards[i], query, scratch[i], perShard[i]); };
+    pool().run(shards.size(), searchShard);
+
+    TopK merged(k, numeric_limits<double>::infinity(), scope.resource());
+    mergeShards(perShard, merged);
+    for (const auto& n : merged.items){
+        results.emplace_back(n.index, getInverseSim(sqrt(n.distSquare)));
+    }
+}
+
+void Catalog::nearestSongs(const double* target, size_t count, vector<Neighbor>& songs){
+    ArenaScope scope;
+    pmr::vector<pmr::vector<Neighbor>> perShard(scope.resource());
+    perShard.reserve(shards.size());
+    for (size_t i = 0; i < shards.size(); i++){
+        // the inner vectors pick up the arena from perShard
+        perShard.emplace_back();
+        perShard.back().reserve(count);
+    }
+    auto searchShard = [&](int i){ ::nearestSongs(shards[i], target, count, perShard[i]); };
+    pool().run(shards.size(), searchShard);
+
+    songs.clear();
+    for (const auto& heap : perShard){
+        songs.insert(songs.end(), heap.begin(), heap.end());
+    }
+    auto closer = [](const Neighbor& a, const Neighbor& b){ return a.distSquare < b.distSquare; };
+    size_t keep = min(count, songs.size());
+    partial_sort(songs.begin(), songs.begin() + keep, songs.end(), closer);
+    songs.resize(keep);
+}
+
+void Catalog::radius(int index, double r, vector<SongResult>& results){
+    if (scalingMode() != ScalingMode::MinMax){
+        throw logic_error("radius searches need MinMax scaling");
+    }
+    results.clear();
+    ArenaScope scope;
+
+    const string& searchArtist = song(index).artist;
+    const double* search = featureRow(index);
+    int searchTrack = trackId(index);
+    pmr::vector<TopK> perShard(scope.resource());
+    perShard.reserve(shards.size());
+    for (size_t i = 0; i < shards.size(); i++){
+        perShard.emplace_back(10, r * r, scope.resource());
+    }
+    auto searchShard = [&](int i){ rNN(shards[i], search, searchTrack, searchArtist, r, perShard[i]); };
+    pool().run(shards.size(), searchShard);
+
+    TopK merged(10, r * r, scope.resource());
+    mergeShards(perShard, merged);
+    if (merged.items.size() < 10){
+        return;
+    }
+    for (const auto& n : merged.items){
+        results.emplace_back(n.index, getPercentSim(sqrt(n.distSquare)));
+    }
+}
+
+unordered_map<string,vector<pair<string,int>>> getTrack_Artist(const Catalog& catalog){
+    unordered_map<string,vector<pair<string,int>>> ret;
+    ret.reserve(catalog.size());
+    for (const auto& shard : catalog.shards){
+        // in file order so the first version of a track is still the first one in the csv
+        for (int row = 0; row < shard.songs.size(); row++){
+            const song_data& song = shard.songs[shard.positions[row]];
+            ret[song.track].emplace_back(make_pair(song.artist, shard.offset + row));
+        }
+    }
+    return ret;
+}
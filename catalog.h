@@ -0,0 +1,232 @@
+// the song catalog, split into shards that are loaded and searched in parallel
+#pragma once
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "data_parse.h"
+#include "query_arena.h"
+#include "curve_order.h"
+
+enum class SeedAggregate; // multi_seed.h
+
+// stored songs per box of a shard, and boxes per super box
+const int SHARD_BOX_SONGS = 64;
+const int SUPER_BOX_BOXES = 64;
+
+// bounding box of the scaled features of a run of stored songs, the shard boxes and the block store's zone maps
+struct FeatureBox {
+    double min[NUM_FEATURES];
+    double max[NUM_FEATURES];
+};
+
+// a box around nothing, growing it by something gives that thing's box
+FeatureBox emptyBox();
+
+// grows box until it holds the box min .. max too, pass the same row twice for one song
+void growBox(FeatureBox& box, const double* min, const double* max);
+
+// squared distance from a point to the closest point of a box, 0 if it is inside
+double boxDistanceSquare(const FeatureBox& box, const double* point);
+
+/*
+One shard of the catalog, loaded from its own csv file.
+Songs are referred to by a global index, the shard's songs are offset .. offset + songs.size() - 1
+where offset + r is row r of the file. The songs can be stored in a different order than the file
+(see SongOrder) so songs, features and trackIds are indexed by storage position, rows and positions
+translate between the two
+*/
+struct Shard {
+    std::string source;
+    std::vector<song_data> songs;
+    FeatureMatrix features;
+    std::vector<int> trackIds; // catalog wide id of each song's track name, used to skip duplicates
+    std::vector<int> rows;      // file row of the song stored at each position
+    std::vector<int> positions; // storage position of each file row
+    // box b holds the songs stored at b * SHARD_BOX_SONGS onwards, super box s holds boxes s * SUPER_BOX_BOXES
+    // onwards. they are only tight when the songs are in curve order
+    std::vector<FeatureBox> boxes;
+    std::vector<FeatureBox> superBoxes;
+    int offset = 0;
+
+    // global index of the song stored at a position
+    int globalIndex(int position) const { return offset + rows[position]; }
+};
+
+// compact search result, the global index of a song and its squared distance to the query
+struct Neighbor {
+    int index;
+    int64_t trackId; // catalog track id, or the 64 bit track hash in the block store
+    double distSquare;
+};
+
+/*
+Keeps the k closest songs offered so far, closest first, with at most one song per track name
+(the closest version of it). Each shard fills its own TopK and they are merged with offer as well,
+which gives the same result as searching everything at once.
+*/
+struct TopK {
+    int k;
+    double maxDistSquare; // songs this far away or further are never kept
+    std::pmr::vector<Neighbor> items;
+
+    // during a search the items should come from the arena of the ArenaScope
+    TopK(int k = 10, double maxDistSquare = std::numeric_limits<double>::infinity(),
+         std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : k(k), maxDistSquare(maxDistSquare), items(resource) {
+        items.reserve(k + 1);
+    }
+
+    // anything at or past this distance can't get in
+    double bound() const {
+        return (items.size() < k) ? maxDistSquare : items.back().distSquare;
+    }
+
+    void offer(const Neighbor& n){
+        if (n.distSquare >= bound()){
+            return;
+        }
+        // only keep the closest version of each track
+        for (size_t i = 0; i < items.size(); i++){
+            if (items[i].trackId == n.trackId){
+                if (items[i].distSquare <= n.distSquare){
+                    return;
+                }
+                items.erase(items.begin() + i);
+                break;
+            }
+        }
+        auto pos = std::upper_bound(items.begin(), items.end(), n.distSquare,
+                                    [](double d, const Neighbor& other){ return d < other.distSquare; });
+        items.insert(pos, n);
+        if (items.size() > k){
+            items.pop_back();
+        }
+    }
+};
+
+/*
+Small fixed pool of worker threads used to fan work out over the shards.
+run(count, task) calls task(i) for every i in [0, count) and returns when all are done,
+the calling thread works on the tasks too
+*/
+class ShardPool {
+public:
+    explicit ShardPool(int threads);
+    ~ShardPool();
+
+    // threads that run tasks, the workers and the calling thread
+    int threads() const { return workers.size() + 1; }
+
+    template <class F>
+    void run(int count, F& task){
+        runTasks(count, &task, [](void* context, int i){ (*static_cast<F*>(context))(i); });
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    bool stopping = false;
+    int generation = 0;
+    int taskCount = 0;
+    int running = 0; // workers still inside the current generation
+    std::atomic<int> nextTask{0};
+    void* taskContext = nullptr;
+    void (*taskFunction)(void*, int) = nullptr;
+
+    void runTasks(int count, void* context, void (*function)(void*, int));
+    void drainTasks(void* context, void (*function)(void*, int), int count);
+    void workerLoop();
+};
+
+/*
+dataset.csv and any dataset_*.csv files next to the executable, sorted by name.
+throws runtime_error if there are none
+*/
+std::vector<std::filesystem::path> datasetFiles(const std::string& exePath);
+
+/*
+The whole catalog. Every shard is normalized with the same global stats so distances
+between songs in different shards can be compared, and searches run on every shard
+at the same time before the per shard results are merged.
+*/
+class Catalog {
+public:
+    std::vector<Shard> shards;
+
+    /*
+    loads dataset.csv and any dataset_*.csv files next to the executable, one shard per file.
+    MAIN HAS TO PASS ARGV[0] here otherwise the files can't be found
+    */
+    void load(const std::string& exePath, ScalingMode mode = ScalingMode::MinMax, SongOrder order = SongOrder::File);
+
+    /*
+    loads the given files in parallel, one shard per file.
+    with order set to Morton or Hilbert the songs of each shard are stored along that curve, global indices
+    (and everything that returns them) still follow the file rows.
+    throws runtime_error if paths is empty
+    */
+    void loadFiles(const std::vector<std::filesystem::path>& paths, ScalingMode mode = ScalingMode::MinMax,
+                   SongOrder order = SongOrder::File);
+
+    size_t size() const { return totalSongs; }
+    const song_data& song(int index) const;
+    const double* featureRow(int index) const;
+    int trackId(int index) const;
+
+    // the global stats of a feature column, in the raw units of the csv
+    const ColumnStats& columnStats(int column) const { return shards.front().features.stats[column]; }
+
+    ScalingMode scalingMode() const { return shards.front().features.mode; }
+
+    // maps raw feature values (csv units) into the scaled space the searches work in
+    void scaleFeatures(const double* raw, double* scaled) const;
+
+    /*
+    The searches write their results into the passed in vector (cleared first) so the caller can reuse it.
+    Temporaries come from the per thread QueryArena, so once the vector and the arena have grown
+    to fit, a search doesn't allocate anything
+    */
+
+    // the k nearest songs to the song at index, skipping other versions of the same track
+    void kNearest(int k, int index, std::vector<SongResult>& results);
+
+    // the 10 closest songs within radius r of the song at index, empty if fewer than 10 are in range.
+    // needs MinMax scaling (throws logic_error otherwise, see ScalingMode)
+    void radius(int index, double r, std::vector<SongResult>& results);
+
+    // the k nearest songs to any point of the scaled feature space, for example one set with sliders
+    void kNearestTo(int k, const double* target, std::vector<SongResult>& results);
+
+    /*
+    the k songs that score best against a whole set of seed songs (see SeedAggregate in multi_seed.h),
+    never any of the seeds or other versions of their tracks. weights are only used by Weighted
+    */
+    void kNearestMulti(int k, const std::vector<int>& seeds, const std::vector<double>& weights,
+                       SeedAggregate aggregate, std::vector<SongResult>& results);
+
+    // the count nearest songs to target (duplicates included), closest first, for IncrementalKNN
+    void nearestSongs(const double* target, size_t count, std::vector<Neighbor>& songs);
+
+    ShardPool& pool() { return *workers; }
+
+private:
+    size_t totalSongs = 0;
+    std::unique_ptr<ShardPool> workers;
+
+    // shard that holds the song at a global index
+    const Shard& shardOf(int index) const;
+
+    // fan out for kNearest and kNearestTo, skipTrack is -1 to skip nothing
+    void nearest(int k, const double* target, int skipTrack, std::vector<SongResult>& results);
+};
+
+/*
+Helper to associate names of songs with their artists and global index for lookup by name.
+Returns a map where the key is the song title and the value is a vector of every artist
+with that song and the global index of their version
+*/
+std::unordered_map<std::string,std::vector<std::pair<std::string,int>>> getTrack_Artist(const Catalog& catalog);
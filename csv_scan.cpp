@@ -0,0 +1,252 @@
+#include "csv_scan.h"
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+using namespace std;
+
+#if defined(__AVX2__)
+static inline uint64_t matchMask(__m256i lo, __m256i hi, char c){
+    __m256i v = _mm256_set1_epi8(c);
+    uint64_t low = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, v)));
+    uint64_t high = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, v)));
+    return low | (high << 32);
+}
+
+BlockMasks classifyBlock(const char* block){
+    __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+    __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+    return {matchMask(lo, hi, '"'), matchMask(lo, hi, ','), matchMask(lo, hi, ';'), matchMask(lo, hi, '\n')};
+}
+#elif defined(__SSE2__)
+static inline uint64_t matchMask(const __m128i* chunks, char c){
+    __m128i v = _mm_set1_epi8(c);
+    uint64_t mask = 0;
+    for (int i = 0; i < 4; i++){
+        uint64_t bits = static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunks[i], v)));
+        mask |= bits << (16 * i);
+    }
+    return mask;
+}
+
+BlockMasks classifyBlock(const char* block){
+    __m128i chunks[4];
+    for (int i = 0; i < 4; i++){
+        chunks[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * i));
+    }
+    return {matchMask(chunks, '"'), matchMask(chunks, ','), matchMask(chunks, ';'), matchMask(chunks, '\n')};
+}
+#elif defined(__aarch64__)
+// neon has no movemask, so weight each byte by its bit and add neighbours together (same as simdjson)
+static inline uint64_t matchMask(const uint8x16_t* chunks, char c){
+    const uint8x16_t weights = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t v = vdupq_n_u8(static_cast<uint8_t>(c));
+    uint8x16_t t0 = vandq_u8(vceqq_u8(chunks[0], v), weights);
+    uint8x16_t t1 = vandq_u8(vceqq_u8(chunks[1], v), weights);
+    uint8x16_t t2 = vandq_u8(vceqq_u8(chunks[2], v), weights);
+    uint8x16_t t3 = vandq_u8(vceqq_u8(chunks[3], v), weights);
+    uint8x16_t sum0 = vpaddq_u8(t0, t1);
+    uint8x16_t sum1 = vpaddq_u8(t2, t3);
+    sum0 = vpaddq_u8(sum0, sum1);
+    sum0 = vpaddq_u8(sum0, sum0);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(sum0), 0);
+}
+
+BlockMasks classifyBlock(const char* block){
+    uint8x16_t chunks[4];
+    for (int i = 0; i < 4; i++){
+        chunks[i] = vld1q_u8(reinterpret_cast<const uint8_t*>(block + 16 * i));
+    }
+    return {matchMask(chunks, '"'), matchMask(chunks, ','), matchMask(chunks, ';'), matchMask(chunks, '\n')};
+}
+#else
+BlockMasks classifyBlock(const char* block){
+    BlockMasks masks = {0, 0, 0, 0};
+    for (int i = 0; i < 64; i++){
+        uint64_t bit = uint64_t(1) << i;
+        if (block[i] == '"') masks.quote |= bit;
+        if (block[i] == ',') masks.comma |= bit;
+        if (block[i] == ';') masks.semicolon |= bit;
+        if (block[i] == '\n') masks.newline |= bit;
+    }
+    return masks;
+}
+#endif
+
+static inline int lowestBit(uint64_t x){
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+// bits from..63 set (none if from is 64)
+static inline uint64_t bitsFrom(int from){
+    return (from >= 64) ? 0 : (~uint64_t(0) << from);
+}
+
+// bits [from, to)
+static inline uint64_t bitRange(int from, int to){
+    return bitsFrom(from) & ~bitsFrom(to);
+}
+
+void fieldText(const FieldSpan& field, string& out){
+    if (!field.dirty){
+        out.assign(field.begin, field.end);
+        return;
+    }
+    // same rules as parseRow, the only commas left in here are inside quotes
+    out.clear();
+    for (const char* c = field.begin; c != field.end; c++){
+        if (*c == '"'){
+            continue;
+        }
+        else if (*c == ';'){
+            out += ", ";
+        }
+        else {
+            out += *c;
+        }
+    }
+}
+
+double fieldDouble(const FieldSpan& field){
+    if (field.dirty){
+        string text;
+        fieldText(field, text);
+        return stod(text);
+    }
+    char* end;
+    double value = strtod(field.begin, &end);
+    if (end == field.begin){
+        throw invalid_argument("stod");
+    }
+    return value;
+}
+
+int fieldInt(const FieldSpan& field){
+    if (field.dirty){
+        string text;
+        fieldText(field, text);
+        return stoi(text);
+    }
+    char* end;
+    long value = strtol(field.begin, &end, 10);
+    if (end == field.begin){
+        throw invalid_argument("stoi");
+    }
+    return static_cast<int>(value);
+}
+
+void scanCsvSpans(const char* data, size_t size,
+                  const function<void(const FieldSpan* fields, size_t count)>& onRow){
+    vector<FieldSpan> fields(32);
+    size_t count = 0;
+    size_t fieldStart = 0;  // first byte of the field being read
+    size_t rowStart = 0;    // first byte of the row being read
+    bool fieldDirty = false; // the field has quotes or ; so it can't just be copied
+    bool inQuotes = false;   // quote state at the start of the block, for a row that started in an earlier block
+
+    auto emitField = [&](size_t end){
+        if (count == fields.size()){
+            fields.resize(count * 2);
+        }
+        fields[count++] = {data + fieldStart, data + end, fieldDirty};
+        fieldDirty = false;
+    };
+
+    char tail[64];
+    for (size_t blockStart = 0; blockStart < size; blockStart += 64){
+        const char* block = data + blockStart;
+        // the last partial block is copied into a zero padded buffer so nothing past the end is read
+        if (size - blockStart < 64){
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, block, size - blockStart);
+            block = tail;
+        }
+        BlockMasks masks = classifyBlock(block);
+        uint64_t newlines = masks.newline;
+        uint64_t special = masks.quote | masks.semicolon;
+        uint64_t quoteParity = prefixXor(masks.quote);
+
+        // each piece of the block between newlines belongs to one row
+        int segmentStart = 0;
+        while (true){
+            int segmentEnd = newlines ? lowestBit(newlines) : 64;
+            uint64_t segment = bitRange(segmentStart, segmentEnd);
+
+            uint64_t separators;
+            if ((special & segment) == 0 && !inQuotes){
+                // no quotes or ; anywhere here, every comma splits and no field is dirty (the common case)
+                separators = masks.comma & segment;
+                while (separators){
+                    int p = lowestBit(separators);
+                    emitField(blockStart + p);
+                    fieldStart = blockStart + p + 1;
+                    separators &= separators - 1;
+                }
+            }
+            else {
+                // quote parity restarts at 0 for every row, so flip the block wide parity to match
+                bool startParity = (segmentStart == 0) ? inQuotes : ((quoteParity >> (segmentStart - 1)) & 1);
+                uint64_t quoted = quoteParity ^ (startParity ? ~uint64_t(0) : 0);
+                separators = masks.comma & ~quoted & segment;
+                while (separators){
+                    int p = lowestBit(separators);
+                    int from = max<int>(segmentStart, static_cast<int>(max(fieldStart, blockStart) - blockStart));
+                    if (special & bitRange(from, p)){
+                        fieldDirty = true;
+                    }
+                    emitField(blockStart + p);
+                    fieldStart = blockStart + p + 1;
+                    separators &= separators - 1;
+                }
+                int from = max<int>(segmentStart, static_cast<int>(max(fieldStart, blockStart) - blockStart));
+                if (special & bitRange(from, segmentEnd)){
+                    fieldDirty = true;
+                }
+                if (segmentEnd == 64){
+                    inQuotes = (quoted >> 63) & 1;
+                }
+            }
+
+            if (segmentEnd == 64){
+                // the row goes on into the next block
+                break;
+            }
+
+            // newline, end of the row
+            emitField(blockStart + segmentEnd);
+            onRow(fields.data(), count);
+            count = 0;
+            inQuotes = false;
+            fieldStart = rowStart = blockStart + segmentEnd + 1;
+            newlines &= newlines - 1;
+            segmentStart = segmentEnd + 1;
+        }
+    }
+
+    // last line without a newline at the end
+    if (rowStart < size){
+        emitField(size);
+        onRow(fields.data(), count);
+    }
+}
+
+void scanCsv(const char* data, size_t size, vector<string>& fields,
+             const function<void(const vector<string>&)>& onRow){
+    scanCsvSpans(data, size, [&](const FieldSpan* spans, size_t count){
+        fields.resize(count);
+        for (size_t i = 0; i < count; i++){
+            fieldText(spans[i], fields[i]);
+        }
+        onRow(fields);
+    });
+}
@@ -0,0 +1,66 @@
+// vectorized csv tokenizer used by loadFile
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+Bitmasks for one 64 byte block, bit i is set if byte i of the block is that character
+*/
+struct BlockMasks {
+    uint64_t quote;
+    uint64_t comma;
+    uint64_t semicolon;
+    uint64_t newline;
+};
+
+// compares 64 bytes at once against each of the special characters (sse2/avx2/neon, plain loop otherwise)
+BlockMasks classifyBlock(const char* block);
+
+/*
+bit i of the result is the xor of bits 0..i of x.
+applied to the quote mask this gives the bytes that are inside quotes (opening quote included)
+*/
+inline uint64_t prefixXor(uint64_t x){
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+// one field of a row as a range of the csv buffer, dirty if it has quotes or ; that need cleaning up
+struct FieldSpan {
+    const char* begin;
+    const char* end;
+    bool dirty;
+};
+
+// the text of a field, the same as parseRow would give for it (quotes dropped, ; becomes ", ")
+void fieldText(const FieldSpan& field, std::string& out);
+
+/*
+number in a field, same as calling stod on its text.
+the buffer has to continue with a , newline or \0 after the field so strtod knows where to stop
+*/
+double fieldDouble(const FieldSpan& field);
+int fieldInt(const FieldSpan& field);
+
+/*
+Splits a whole csv buffer into rows and fields 64 bytes at a time and calls onRow for each line
+with the boundaries of every field, without copying anything.
+Lines are split on every newline (like getline) and the fields of each line are exactly what parseRow
+gives for it: commas inside quotes don't split, quotes are dropped and ; becomes ", "
+*/
+void scanCsvSpans(const char* data, size_t size,
+                  const std::function<void(const FieldSpan* fields, size_t count)>& onRow);
+
+/*
+Same as scanCsvSpans but turns the fields into strings like parseRow returns them.
+fields is reused for every row so its strings keep their capacity between rows
+*/
+void scanCsv(const char* data, size_t size, std::vector<std::string>& fields,
+             const std::function<void(const std::vector<std::string>&)>& onRow);
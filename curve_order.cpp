@@ -0,0 +1,78 @@
+#include "curve_order.h"
+using namespace std;
+
+uint64_t mortonKey(const uint32_t* coords){
+    uint64_t key = 0;
+    for (int bit = CURVE_BITS - 1; bit >= 0; bit--){
+        for (int c = 0; c < NUM_FEATURES; c++){
+            key = (key << 1) | ((coords[c] >> bit) & 1);
+        }
+    }
+    return key;
+}
+
+uint64_t hilbertKey(uint32_t* x){
+    // undo the excess work of the gray code, from the top bit down
+    uint32_t top = uint32_t(1) << (CURVE_BITS - 1);
+    for (uint32_t q = top; q > 1; q >>= 1){
+        uint32_t p = q - 1;
+        for (int c = 0; c < NUM_FEATURES; c++){
+            if (x[c] & q){
+                x[0] ^= p; // invert
+            }
+            else {
+                uint32_t t = (x[0] ^ x[c]) & p; // exchange
+                x[0] ^= t;
+                x[c] ^= t;
+            }
+        }
+    }
+
+    // gray encode
+    for (int c = 1; c < NUM_FEATURES; c++){
+        x[c] ^= x[c - 1];
+    }
+    uint32_t t = 0;
+    for (uint32_t q = top; q > 1; q >>= 1){
+        if (x[NUM_FEATURES - 1] & q){
+            t ^= q - 1;
+        }
+    }
+    for (int c = 0; c < NUM_FEATURES; c++){
+        x[c] ^= t;
+    }
+
+    // the transposed bits read off in the same interleaved order as morton
+    return mortonKey(x);
+}
+
+vector<int> curveOrder(const FeatureMatrix& features, const double* low, const double* high, SongOrder order){
+    vector<int> rows(features.size());
+    for (int i = 0; i < rows.size(); i++){
+        rows[i] = i;
+    }
+    if (order == SongOrder::File){
+        return rows;
+    }
+
+    // snap every column onto a 2^CURVE_BITS grid between its bounds
+    const uint32_t cells = uint32_t(1) << CURVE_BITS;
+    vector<pair<uint64_t,int>> keys(rows.size());
+    for (int i = 0; i < rows.size(); i++){
+        const double* row = features.row(i);
+        uint32_t coords[NUM_FEATURES];
+        for (int c = 0; c < NUM_FEATURES; c++){
+            double range = high[c] - low[c];
+            double t = (range > 0) ? (row[c] - low[c]) / range : 0;
+            coords[c] = min<uint32_t>(cells - 1, static_cast<uint32_t>(max(0.0, t) * cells));
+        }
+        keys[i] = {order == SongOrder::Morton ? mortonKey(coords) : hilbertKey(coords), i};
+    }
+
+    // ties keep their file order
+    sort(keys.begin(), keys.end());
+    for (int i = 0; i < rows.size(); i++){
+        rows[i] = keys[i].second;
+    }
+    return rows;
+}
@@ -0,0 +1,28 @@
+// space filling curve orders, used to store songs that are close in feature space close in memory
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "data_parse.h"
+
+/*
+How the songs of a shard are stored
+File    - in the order of the csv (grouped by genre)
+Morton  - along a z-order curve over the scaled features, cheap but has big jumps
+Hilbert - along a hilbert curve over the scaled features, neighbours on the curve are always close
+*/
+enum class SongOrder { File, Morton, Hilbert };
+
+// bits per feature in a curve key, 7 features * 9 bits fits in 63 bits
+const int CURVE_BITS = 9;
+
+// interleaves the bits of the coordinates (CURVE_BITS each), most significant bits first
+uint64_t mortonKey(const uint32_t* coords);
+
+// position on the hilbert curve through the coordinates (skilling's transpose method), coords is changed
+uint64_t hilbertKey(uint32_t* coords);
+
+/*
+The order to store the rows of features in, order[i] is the row that goes to position i.
+low and high are the bounds of every scaled column (the same for every shard, so keys are comparable)
+*/
+std::vector<int> curveOrder(const FeatureMatrix& features, const double* low, const double* high, SongOrder order);
@@ -1,17 +1,8 @@
 #include "data_parse.h"
+#include "csv_scan.h"
 
 
 
-std::unordered_map<std::string,std::vector<std::pair<std::string,int>>> getTrack_Artist(const std::vector<song_data>& d){
-    std::unordered_map<std::string,std::vector<std::pair<std::string,int>>> ret;
-    ret.reserve(d.size());
-    for (int i = 0; i < d.size(); i++){
-        ret[d[i].track].emplace_back(std::make_pair(d[i].artist,i));
-    }
-    return ret;
-}
-
-
 std::vector<std::string> parseRow(const std::string& line){
     // there will always be 21 elements max in vector so reserve in advance
     std::vector<std::string> data;
@@ -39,52 +30,141 @@ std::vector<std::string> parseRow(const std::string& line){
     return data;
 }
 
-void normalize(std::vector<song_data>& songs){
-    if (songs.empty()){
-        return;
-    }
+void song_data::rawFeatures(double* raw) const {
+    raw[DURATION] = duration;
+    raw[ENERGY] = energy;
+    raw[SPEECHINESS] = speechiness;
+    raw[ACOUSTICNESS] = acousticness;
+    raw[INSTRUMENTALNESS] = instrumentalness;
+    raw[VALENCE] = valence;
+    raw[TEMPO] = tempo;
+}
 
-    // find the minimum and maximum values of the duration and tempo
+void FeatureMatrix::push(const song_data& s){
+    double raw[NUM_FEATURES];
+    s.rawFeatures(raw);
+    for (int c = 0; c < NUM_FEATURES; c++){
+        values.push_back(raw[c]);
+        stats[c].add(raw[c]);
+    }
+}
 
-    auto minmaxDur = std::minmax_element(songs.begin(),songs.end(),[](const song_data& a, const song_data& b){return a.duration < b.duration;});
+// median and interquartile range of one column across all the parts, only needed for robust scaling.
+// the column is copied once and the three percentiles come out of the same buffer,
+// each nth_element only has to partition the side the previous one left it on
+static void columnQuartiles(const std::vector<FeatureMatrix*>& parts, int col, double& median, double& iqr){
+    std::vector<double> column;
+    size_t total = 0;
+    for (const FeatureMatrix* part : parts){
+        total += part->size();
+    }
+    column.reserve(total);
+    for (const FeatureMatrix* part : parts){
+        for (size_t i = col; i < part->values.size(); i += NUM_FEATURES){
+            column.push_back(part->values[i]);
+        }
+    }
+    size_t last = column.size() - 1;
+    auto mid = column.begin() + static_cast<size_t>(0.5 * last);
+    auto low = column.begin() + static_cast<size_t>(0.25 * last);
+    auto high = column.begin() + static_cast<size_t>(0.75 * last);
+    std::nth_element(column.begin(), mid, column.end());
+    std::nth_element(column.begin(), low, mid);
+    std::nth_element(mid + 1 > high ? high : mid + 1, high, column.end());
+    median = *mid;
+    iqr = *high - *low;
+}
 
-    auto minmaxTempo = std::minmax_element(songs.begin(),songs.end(),[](const song_data& a, const song_data& b){return a.tempo < b.tempo;});
-    
-    // store these so they won't be modified as we go through the data
-    double durRange = minmaxDur.second->duration - minmaxDur.first->duration;
-    double tempoRange = minmaxTempo.second->tempo - minmaxTempo.first->tempo;
+void shareScaling(const std::vector<FeatureMatrix*>& parts, ScalingMode mode){
+    ColumnStats stats[NUM_FEATURES];
+    for (const FeatureMatrix* part : parts){
+        for (int c = 0; c < NUM_FEATURES; c++){
+            stats[c].merge(part->stats[c]);
+        }
+    }
 
-    double durMin = minmaxDur.first->duration;
-    double tempoMin = minmaxTempo.first->tempo;
+    double offset[NUM_FEATURES];
+    double scale[NUM_FEATURES];
+    for (int c = 0; c < NUM_FEATURES; c++){
+        offset[c] = 0;
+        scale[c] = 1;
+        if (stats[c].count == 0){
+            continue;
+        }
+        if (mode == ScalingMode::MinMax){
+            // currNormalized = (curr-min)/(max-min)
+            // only duration and tempo, everything else is already between 0 and 1
+            if (c == DURATION || c == TEMPO){
+                offset[c] = stats[c].min;
+                scale[c] = stats[c].max - stats[c].min;
+            }
+        }
+        else if (mode == ScalingMode::ZScore){
+            offset[c] = stats[c].mean;
+            scale[c] = stats[c].stddev();
+        }
+        else {
+            columnQuartiles(parts, c, offset[c], scale[c]);
+        }
+        // a constant column maps everything to 0
+        if (scale[c] == 0){
+            scale[c] = 1;
+        }
+    }
 
-    // currNormalized = (curr-min)/(max-min) 
-    // normalize all values
-    for (auto& song : songs){
-        song.duration = (durRange == 0) ? 0 : (song.duration - durMin) / durRange;
-        song.tempo = (tempoRange == 0) ? 0 : (song.tempo - tempoMin) / tempoRange;
+    // every part keeps the combined stats so a raw value means the same thing everywhere
+    for (FeatureMatrix* part : parts){
+        part->mode = mode;
+        for (int c = 0; c < NUM_FEATURES; c++){
+            part->stats[c] = stats[c];
+            part->offset[c] = offset[c];
+            part->scale[c] = scale[c];
+        }
     }
 }
 
-std::vector<song_data> loadData(std::string exePath){
-    // the following 3 lines find the dataset path across systems
-    // this is necessary for the file to be properly opened
-    std::filesystem::path exPath(exePath);
-    std::filesystem::path Pdirectory = exPath.parent_path();
-    std::filesystem::path datasetPath = Pdirectory/"dataset.csv";
+void FeatureMatrix::applyScaling(){
+    // one pass over the flat doubles, the song structs are never touched again
+    double inv[NUM_FEATURES];
+    for (int c = 0; c < NUM_FEATURES; c++){
+        inv[c] = 1.0 / scale[c];
+    }
+    for (size_t i = 0; i < values.size(); i += NUM_FEATURES){
+        for (int c = 0; c < NUM_FEATURES; c++){
+            values[i + c] = (values[i + c] - offset[c]) * inv[c];
+        }
+    }
+}
 
-    std::ifstream dataset(datasetPath.string());
+std::vector<song_data> loadFile(const std::filesystem::path& path, FeatureMatrix& features){
+    std::ifstream dataset(path.string(), std::ios::binary);
     if (!dataset.is_open()){
         throw std::runtime_error("Failed to open file");
     }
+    // read the whole file at once so the tokenizer can go through it in big blocks
+    std::string buffer;
+    dataset.seekg(0, std::ios::end);
+    buffer.resize(static_cast<size_t>(dataset.tellg()));
+    dataset.seekg(0, std::ios::beg);
+    dataset.read(&buffer[0], buffer.size());
+
     // main processing loop
     std::vector<song_data> data;
     data.reserve(100000);
-    std::string line;
-    getline(dataset,line); // skip the header line
-    while (std::getline(dataset,line)){
-        std::vector<std::string> rowData = parseRow(line);
-        data.emplace_back(rowData);
+    features = FeatureMatrix();
+    features.values.reserve(100000 * NUM_FEATURES);
+
+    size_t headerEnd = buffer.find('\n'); // skip the header line
+    if (headerEnd == std::string::npos){
+        return data;
     }
-    normalize(data);
+    scanCsvSpans(buffer.data() + headerEnd + 1, buffer.size() - headerEnd - 1,
+                 [&](const FieldSpan* row, size_t count){
+                     if (count < 21){
+                         return; // blank or broken line
+                     }
+                     data.emplace_back(row);
+                     features.push(data.back());
+                 });
     return data;
-}
\ No newline at end of file
+}
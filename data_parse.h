@@ -7,6 +7,9 @@
 #include <algorithm>
 #include <unordered_map>
 #include <filesystem> // need c++ 17
+#include <limits>
+#include <cmath>
+#include "csv_scan.h"
 
 /*
 Container for all relevant song data from a dataset of spotify songs
@@ -17,23 +20,26 @@ struct song_data {
     std::string album;
     std::string track;
     std::string genre;
+    int popularity; // 0 to 100, used to rank autocomplete suggestions
     
-    // numbers for distance
-    double duration; // needs to be normalized
+    // numbers for distance, kept as they appear in the csv
+    // the scaled copies used for distance live in the FeatureMatrix
+    double duration;
     double energy;
     double speechiness;
     double acousticness;
     double instrumentalness; 
     double valence;
-    double tempo; // needs to be normalized
+    double tempo;
 
     
     
-    song_data(std::vector<std::string> d):
+    song_data(const std::vector<std::string>& d):
         artist(d[2]),
         album(d[3]),
         track(d[4]),
         genre(d[20]),
+        popularity(stoi(d[5])),
         duration(stod(d[6])),
         energy(stod(d[9])),
         speechiness(stod(d[13])), 
@@ -43,12 +49,33 @@ struct song_data {
         tempo(stod(d[18]))
     {}
 
+    // same as above but straight from the csv buffer, only the text fields become strings
+    song_data(const FieldSpan* d):
+        popularity(fieldInt(d[5])),
+        duration(fieldDouble(d[6])),
+        energy(fieldDouble(d[9])),
+        speechiness(fieldDouble(d[13])), 
+        acousticness(fieldDouble(d[14])),
+        instrumentalness(fieldDouble(d[15])),
+        valence(fieldDouble(d[17])),
+        tempo(fieldDouble(d[18]))
+    {
+        fieldText(d[2], artist);
+        fieldText(d[3], album);
+        fieldText(d[4], track);
+        fieldText(d[20], genre);
+    }
+
+    // fills raw with the NUM_FEATURES distance features in csv units, in Feature order
+    void rawFeatures(double* raw) const;
+
     // for debug purposes
     void Print(){
               std::cout << "Artist: " << artist << std::endl;
         std::cout << "Album: " << album<< std::endl;
         std::cout << "Song: " << track << std::endl;
         std::cout << "Genre: " << genre << std::endl;
+        std::cout << "Popularity: " << popularity << std::endl;
 
         std::cout << "Duration: " << duration << std::endl;
         std::cout << "Energy :" << energy << std::endl;
@@ -61,37 +88,120 @@ struct song_data {
 };
 
 // this struct holds information about each recommended song
-// it stores the track name, artist, and how similar it is to the search query (0.0 to 1.0)
+// it stores the songs index in the catalog and how similar it is to the search query (0.0 to 1.0)
+// the track name and artist are only looked up from the index when the results are displayed
 struct SongResult {
-    std::string trackName;
-    std::string artist;
+    int index;
     float similarity;
     
-    SongResult(const std::string& name, const std::string& art, float sim)
-        : trackName(name), artist(art), similarity(sim) {}
+    SongResult(int index, float sim)
+        : index(index), similarity(sim) {}
 };
 
-/* 
-Helper to associate names of songs artists with their artists and index in the larger vector for lookup by name.
-Returns a map where the key is the song title and the value is a vector corresponding 
-to each artist for that song and the songs index in the vector of all songs which is passed in
+/*
+Column order of the feature matrix, every distance calculation goes through these 7 values
 */
-std::unordered_map<std::string,std::vector<std::pair<std::string,int>>> getTrack_Artist(const std::vector<song_data>& d);
+enum Feature {
+    DURATION,
+    ENERGY,
+    SPEECHINESS,
+    ACOUSTICNESS,
+    INSTRUMENTALNESS,
+    VALENCE,
+    TEMPO,
+    NUM_FEATURES
+};
+
+/*
+How the feature columns are rescaled at load time
+MinMax  - (x-min)/(max-min) on duration and tempo, the other columns are already 0 to 1
+ZScore  - (x-mean)/stddev on every column
+Robust  - (x-median)/(p75-p25) on every column, less sensitive to outliers
+The radius searches and their similarity percentages assume every column is 0 to 1 (a radius of 0.22
+and a max distance of sqrt(7)), so they need MinMax and throw logic_error otherwise.
+kNN, slider and multi seed searches work in every mode
+*/
+enum class ScalingMode { MinMax, ZScore, Robust };
+
+/*
+Running statistics for one feature column.
+Updated once per parsed row so no extra pass over the songs is needed to normalize
+*/
+struct ColumnStats {
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+    double mean = 0;
+    double m2 = 0; // sum of squared differences from the mean (welford)
+    size_t count = 0;
+
+    void add(double v){
+        if (v < min) min = v;
+        if (v > max) max = v;
+        count++;
+        double delta = v - mean;
+        mean += delta / count;
+        m2 += delta * (v - mean);
+    }
+
+    // combines the stats of two parts of a column (chan et al.), used to share stats across shards
+    void merge(const ColumnStats& o){
+        if (o.count == 0) return;
+        if (count == 0){
+            *this = o;
+            return;
+        }
+        min = std::min(min, o.min);
+        max = std::max(max, o.max);
+        size_t total = count + o.count;
+        double delta = o.mean - mean;
+        mean += delta * o.count / total;
+        m2 += o.m2 + delta * delta * (static_cast<double>(count) * o.count / total);
+        count = total;
+    }
+
+    double stddev() const {
+        return (count < 2) ? 0 : std::sqrt(m2 / (count - 1));
+    }
+};
+
+/*
+Flat row major matrix of the scaled features, NUM_FEATURES doubles per song.
+Row i belongs to song i of the vector returned by loadFile.
+offset and scale hold the transform that was applied to each column, so a raw value
+can be mapped into the same space with (raw - offset) / scale
+*/
+struct FeatureMatrix {
+    std::vector<double> values;
+    ColumnStats stats[NUM_FEATURES];
+    double offset[NUM_FEATURES];
+    double scale[NUM_FEATURES];
+    ScalingMode mode = ScalingMode::MinMax;
+
+    size_t size() const { return values.size() / NUM_FEATURES; }
+    const double* row(size_t i) const { return values.data() + i * NUM_FEATURES; }
+
+    // appends the raw features of a song and updates the running stats
+    void push(const song_data& s);
+
+    // rescales every row in place with offset and scale
+    void applyScaling();
+};
+
+/*
+Computes one offset and scale from the combined stats of all the parts and gives it to each of them,
+so songs in different parts end up in the same space and their distances can be compared.
+Does not rescale, call applyScaling on each part afterwards (they can be done in parallel)
+*/
+void shareScaling(const std::vector<FeatureMatrix*>& parts, ScalingMode mode);
 
 /* 
-Helper for the loadData() function when going through each row of the csv.
 Goes through the passed in row character by character to handle special names and characters.
 This is necessary to correctly parse through elements in csv with , in them (which are enclosed in "")
+loadFile uses the faster scanCsv (csv_scan.h) which splits rows the exact same way, this is the reference for it
 */
 std::vector<std::string> parseRow(const std::string& line);
 
-/* normalizes the duration and tempo for the songs in the song_data struct*/
-void normalize(std::vector<song_data>& songs);
-
-/* 
-loads all data from the dataset.csv file of spotify song data 
-returns a vector of all the songs data in structs.
-MAIN HAS TO TAKE IN ARGC ARGV AND PASS ARGV[0] to loadData otherwise it will NOT
-be able to find dataset.csv to load it
+/*
+loads every row of one csv file into songs, and the raw (not yet scaled) features into features
 */
-std::vector<song_data> loadData(std::string exePath);
+std::vector<song_data> loadFile(const std::filesystem::path& path, FeatureMatrix& features);
@@ -5,23 +5,15 @@
 #include <cmath>
 #include <algorithm>
 #include <unordered_set>
+#include <cstdio>
 #include "data_parse.h"
-#include "rNN.h"
+#include "catalog.h"
+#include "kNN.h"
+#include "multi_seed.h"
+#include "autocomplete.h"
+#include "store_cli.h"
 using namespace std;
 
-// helper function to find euclidean distance between two songs
-double calculateDistance(const song_data& a, const song_data& b) {
-    double sum = 0.0;
-    sum += (a.duration - b.duration) * (a.duration - b.duration);
-    sum += (a.energy - b.energy) * (a.energy - b.energy);
-    sum += (a.speechiness - b.speechiness) * (a.speechiness - b.speechiness);
-    sum += (a.acousticness - b.acousticness) * (a.acousticness - b.acousticness);
-    sum += (a.instrumentalness - b.instrumentalness) * (a.instrumentalness - b.instrumentalness);
-    sum += (a.valence - b.valence) * (a.valence - b.valence);
-    sum += (a.tempo - b.tempo) * (a.tempo - b.tempo);
-    return sqrt(sum);
-}
-
 // helper function to find the index of a song given its name and artist
 // returns -1 if not found
 int findSongIndex(const string& songName, const string& artistName,
@@ -48,73 +40,67 @@ int findSongIndex(const string& songName, const string& artistName,
     return it->second[0].second;
 }
 
-// khoi will implement the K-Nearest Neighbors algorithm here
-vector<SongResult> kNearestNeighbors(int k, int index,
-                                     const vector<song_data>& allSongs
-                                    ){
-    song_data querySong = allSongs[index];
-    cout << "Found song: " << querySong.track << " by " << querySong.artist << endl;
-    
-    // loop through every song and calculate how far it is from the query song
-    vector<pair<double, int>> distances;
-    for (int i = 0; i < allSongs.size(); i++) {
-        // skip the query song itself (including any duplicate entries with same name)
-        if (i == index || allSongs[i].track == querySong.track) continue;
-        double dist = calculateDistance(querySong, allSongs[i]);
-        distances.push_back(make_pair(dist, i));
-    }
-    
-    // sort all the distances from smallest to largest to find the nearest neighbors
-    sort(distances.begin(), distances.end());
-    
-    // take the k nearest songs and convert them to SongResult format so it is ready to display
-    // use a set to track which song names we've already added to avoid duplicates
-    unordered_set<string> seenSongs;
-    vector<SongResult> results;
-    
-    for (int i = 0; i < distances.size() && results.size() < k; i++) {
-        string trackName = allSongs[distances[i].second].track;
-        
-        // only add this song if we haven't seen this track name before
-        if (seenSongs.find(trackName) == seenSongs.end()) {
-            seenSongs.insert(trackName);
-            float similarity = 1.0 / (1.0 + distances[i].first);
-            results.push_back(SongResult(
-                trackName,
-                allSongs[distances[i].second].artist,
-                similarity
-            ));
-        }
-    }
-    
-    return results;
-}
-
-
 // marcelo will implement the radius nearest neighbors algorithm
 vector<SongResult> radiusNearestNeighbors(const string& songName, const string& artistName, int k,
                                           const vector<song_data>& allSongs,
                                           const unordered_map<string, vector<pair<string, int>>>& trackArtistMap);
 
+// adds a rectangle to a batched layer as two triangles
+// the outline is drawn as a bigger rectangle behind the fill, like sf::RectangleShape does it
+void appendRect(sf::VertexArray& layer, sf::FloatRect rect, sf::Color fill,
+                sf::Color outline = sf::Color::Transparent, float outlineThickness = 0.f) {
+    auto quad = [&layer](sf::Vector2f pos, sf::Vector2f size, sf::Color color) {
+        sf::Vector2f a = pos;
+        sf::Vector2f b = {pos.x + size.x, pos.y};
+        sf::Vector2f c = {pos.x + size.x, pos.y + size.y};
+        sf::Vector2f d = {pos.x, pos.y + size.y};
+        layer.append(sf::Vertex{a, color});
+        layer.append(sf::Vertex{b, color});
+        layer.append(sf::Vertex{c, color});
+        layer.append(sf::Vertex{a, color});
+        layer.append(sf::Vertex{c, color});
+        layer.append(sf::Vertex{d, color});
+    };
+    
+    if (outlineThickness > 0.f) {
+        quad({rect.position.x - outlineThickness, rect.position.y - outlineThickness},
+             {rect.size.x + 2.f * outlineThickness, rect.size.y + 2.f * outlineThickness},
+             outline);
+    }
+    quad(rect.position, rect.size, fill);
+}
+
 class MelodyMapUI {
 private:
     sf::RenderWindow window;
     sf::Font font;
     
-    vector<song_data> allSongs;
+    Catalog catalog;
     unordered_map<string, vector<pair<string, int>>> trackArtistMap;
+    FuzzyIndex fuzzyIndex;
     
     // main ui boxes
     sf::RectangleShape searchBox;
     sf::RectangleShape dropdownBox;
     sf::RectangleShape searchButton;
+    sf::RectangleShape likeButton;
+    sf::RectangleShape clearButton;
     sf::RectangleShape resultsPanel;
     
-    // autocomplete stuff
-    sf::RectangleShape suggestionsBox;
-    vector<sf::RectangleShape> suggestionBoxes;
+    // autocomplete stuff, rebuilt only when the suggestions change
+    vector<sf::FloatRect> suggestionBoxes;
     vector<sf::Text> suggestionTexts;
     
+    // algorithm dropdown options, built once
+    vector<string> dropdownOptions;
+    vector<sf::FloatRect> optionBoxes;
+    vector<sf::Text> optionTexts;
+    
+    // every box of a layer goes into one vertex array so each layer is a single draw call
+    sf::VertexArray baseLayer;     // search box, dropdown box, search button, results panel
+    sf::VertexArray overlayLayer;  // open dropdown or autocomplete suggestions
+    sf::RectangleShape cursor;
+    
     // text labels
     sf::Text titleText;
     sf::Text searchLabel;
@@ -122,6 +108,8 @@ private:
     sf::Text algorithmLabel;
     sf::Text dropdownText;
     sf::Text buttonText;
+    sf::Text likeText;
+    sf::Text clearText;
     vector<sf::Text> resultTexts;
     
     // state variables
@@ -135,6 +123,9 @@ private:
     vector<SongResult> results;
     sf::Clock cursorClock;
     bool showCursor;
+    bool dirty;      // something changed since the last frame was drawn
+    bool layersDirty; // a box, highlight or knob changed, so the batched vertex arrays need rebuilding
+    int hoveredRow;  // row of the open dropdown or suggestion list under the mouse, -1 if none
     pair<string, string> searchResults;
 
     // autocomplete state
@@ -149,26 +140,53 @@ private:
     // used to prevent double-clicking on suggestions
     sf::Clock clickClock;
     const float CLICK_DELAY = 0.15f;
+    
+    const sf::Time CURSOR_BLINK = sf::milliseconds(500);
+    
+    // tune by sliders, one slider per feature in the same units as the csv
+    IncrementalKNN sliderSearch;
+    double sliderValues[NUM_FEATURES];
+    vector<sf::Text> sliderTexts;
+    int activeSlider;     // slider being dragged, -1 if none
+    int sliderSeed;       // song the sliders started from until one of them moves, -1 if none
+    bool slidersChanged;  // search again before the next frame
+    const float SLIDER_X = 640.f;
+    const float SLIDER_WIDTH = 280.f;
+    const float SLIDER_TOP = 330.f;
+    const float SLIDER_SPACING = 55.f;
+    
+    // liked songs for the playlist searches, liking a song again makes it count more
+    vector<int> likedSongs;
+    vector<double> likedWeights;
+    vector<sf::Text> likedTexts;
+    const size_t MAX_LIKED_SHOWN = 11;
 
     
 public:
     MelodyMapUI(const string& exePath) : 
+        baseLayer(sf::PrimitiveType::Triangles),
+        overlayLayer(sf::PrimitiveType::Triangles),
         titleText(font),
         searchLabel(font),
         inputText(font),
         algorithmLabel(font),
         dropdownText(font),
-        buttonText(font) {
+        buttonText(font),
+        likeText(font),
+        clearText(font) {
         
         window.create(sf::VideoMode({WINDOW_WIDTH, WINDOW_HEIGHT}), "Melody Map - Song Recommender");
         window.setFramerateLimit(60);
         
-        // load all the songs from the csv
+        // load all the songs from the csv files, one shard per file
         cout << "Loading Spotify dataset..." << endl;
         try {
-            allSongs = loadData(exePath);
-            trackArtistMap = getTrack_Artist(allSongs);
-            cout << "Successfully loaded " << allSongs.size() << " songs!" << endl;
+            // stored along a hilbert curve so songs that are close together are searched together
+            catalog.load(exePath, ScalingMode::MinMax, SongOrder::Hilbert);
+            trackArtistMap = getTrack_Artist(catalog);
+            fuzzyIndex.build(catalog);
+            cout << "Successfully loaded " << catalog.size() << " songs from "
+                 << catalog.shards.size() << " file(s)!" << endl;
         } catch (const exception& e) {
             cerr << "ERROR: Failed to load dataset! " << e.what() << endl;
         }
@@ -201,6 +219,12 @@ public:
         showCursor = true;
         showSuggestions = false;
         selectedSuggestionIndex = -1;
+        dirty = true;
+        layersDirty = true;
+        hoveredRow = -1;
+        activeSlider = -1;
+        sliderSeed = -1;
+        slidersChanged = false;
         
         initializeUI();
     }
@@ -252,15 +276,216 @@ public:
         buttonText.setFillColor(sf::Color::Black);
         buttonText.setPosition({static_cast<float>(WINDOW_WIDTH) / 2.f - 40.f, 230.f});
         
+        likeButton.setSize({90.f, 50.f});
+        likeButton.setPosition({600.f, 220.f});
+        
+        likeText.setString("Like");
+        likeText.setCharacterSize(22u);
+        likeText.setFillColor(sf::Color::White);
+        likeText.setPosition({624.f, 231.f});
+        
+        clearButton.setSize({90.f, 50.f});
+        clearButton.setPosition({700.f, 220.f});
+        
+        clearText.setString("Clear");
+        clearText.setCharacterSize(22u);
+        clearText.setFillColor(sf::Color::White);
+        clearText.setPosition({718.f, 231.f});
+        
         resultsPanel.setSize({900.f, 450.f});
         resultsPanel.setPosition({50.f, 300.f});
         resultsPanel.setFillColor(sf::Color(30u, 30u, 30u));
         resultsPanel.setOutlineColor(sf::Color(100u, 100u, 100u));
         resultsPanel.setOutlineThickness(2.f);
         
-        suggestionsBox.setFillColor(sf::Color(40u, 40u, 40u));
-        suggestionsBox.setOutlineColor(sf::Color(100u, 100u, 100u));
-        suggestionsBox.setOutlineThickness(2.f);
+        cursor.setSize({2.f, 20.f});
+        cursor.setFillColor(sf::Color::White);
+        updateCursor();
+        
+        // the dropdown never changes so its text is only built here
+        dropdownOptions = {"K-Nearest Neighbors", "Radius Nearest Neighbors", "Tune by Sliders",
+                           "Liked Songs (Blend)", "Liked Songs (Any)"};
+        for (size_t i = 0; i < dropdownOptions.size(); ++i) {
+            optionBoxes.push_back(sf::FloatRect({600.f, 190.f + static_cast<float>(i) * 40.f}, {300.f, 40.f}));
+            
+            sf::Text optionText(font);
+            optionText.setString(dropdownOptions[i]);
+            optionText.setCharacterSize(18u);
+            optionText.setFillColor(sf::Color::White);
+            optionText.setPosition({610.f, 198.f + static_cast<float>(i) * 40.f});
+            optionTexts.push_back(optionText);
+        }
+        
+        for (int i = 0; i < NUM_FEATURES; ++i) {
+            sf::Text label(font);
+            label.setCharacterSize(16u);
+            label.setFillColor(sf::Color::White);
+            label.setPosition({SLIDER_X, SLIDER_TOP + static_cast<float>(i) * SLIDER_SPACING});
+            sliderTexts.push_back(label);
+        }
+        if (catalog.size() > 0) {
+            seedSliders(-1);
+        }
+        rebuildLikedTexts();
+    }
+    
+    bool slidersShown() const {
+        return selectedAlgorithm == "Tune by Sliders";
+    }
+    
+    bool likedShown() const {
+        return selectedAlgorithm == "Liked Songs (Blend)" || selectedAlgorithm == "Liked Songs (Any)";
+    }
+    
+    // adds the song in the search box to the liked songs, or counts it again if it is already there
+    void likeSelectedSong() {
+        int songIndex = findSongIndex(searchResults.first, searchResults.second, trackArtistMap);
+        if (songIndex == -1) {
+            cout << "Song not found in database." << endl;
+            return;
+        }
+        auto it = find(likedSongs.begin(), likedSongs.end(), songIndex);
+        if (it == likedSongs.end()) {
+            likedSongs.push_back(songIndex);
+            likedWeights.push_back(1.0);
+        } else {
+            likedWeights[it - likedSongs.begin()] += 1.0;
+        }
+        rebuildLikedTexts();
+    }
+    
+    // the list of liked songs on the right side of the results panel
+    void rebuildLikedTexts() {
+        likedTexts.clear();
+        
+        sf::Text header(font);
+        header.setString("Liked songs (" + to_string(likedSongs.size()) + "):");
+        header.setCharacterSize(18u);
+        header.setFillColor(sf::Color(30u, 215u, 96u));
+        header.setPosition({SLIDER_X, SLIDER_TOP});
+        likedTexts.push_back(header);
+        
+        for (size_t i = 0; i < likedSongs.size() && i < MAX_LIKED_SHOWN; ++i) {
+            const song_data& song = catalog.song(likedSongs[i]);
+            string name = song.track + " - " + song.artist;
+            if (name.length() > 30) {
+                name = name.substr(0, 27) + "...";
+            }
+            if (likedWeights[i] > 1.0) {
+                name += " x" + to_string(static_cast<int>(likedWeights[i]));
+            }
+            
+            sf::Text line(font);
+            line.setString(name);
+            line.setCharacterSize(14u);
+            line.setFillColor(sf::Color::White);
+            line.setPosition({SLIDER_X, SLIDER_TOP + 35.f + static_cast<float>(i) * 30.f});
+            likedTexts.push_back(line);
+        }
+        if (likedSongs.size() > MAX_LIKED_SHOWN) {
+            sf::Text more(font);
+            more.setString("... and " + to_string(likedSongs.size() - MAX_LIKED_SHOWN) + " more");
+            more.setCharacterSize(14u);
+            more.setFillColor(sf::Color(150u, 150u, 150u));
+            more.setPosition({SLIDER_X, SLIDER_TOP + 35.f + static_cast<float>(MAX_LIKED_SHOWN) * 30.f});
+            likedTexts.push_back(more);
+        }
+    }
+    
+    // one pass over the catalog for all the liked songs
+    void performLikedSearch() {
+        results.clear();
+        showSuggestions = false;
+        if (likedSongs.empty()) {
+            cout << "Like some songs first." << endl;
+            updateResultsDisplay();
+            return;
+        }
+        SeedAggregate aggregate = (selectedAlgorithm == "Liked Songs (Any)") ? SeedAggregate::Min : SeedAggregate::Weighted;
+        catalog.kNearestMulti(10, likedSongs, likedWeights, aggregate, results);
+        updateResultsDisplay();
+    }
+    
+    // the bar of a slider, and a taller box around it that counts as grabbing it
+    sf::FloatRect sliderTrack(int i) const {
+        return sf::FloatRect({SLIDER_X, SLIDER_TOP + static_cast<float>(i) * SLIDER_SPACING + 28.f}, {SLIDER_WIDTH, 6.f});
+    }
+    
+    sf::FloatRect sliderHitBox(int i) const {
+        return sf::FloatRect({SLIDER_X - 8.f, SLIDER_TOP + static_cast<float>(i) * SLIDER_SPACING + 18.f},
+                             {SLIDER_WIDTH + 16.f, 26.f});
+    }
+    
+    // where the knob sits, 0 at the smallest value in the catalog and 1 at the largest
+    float sliderFraction(int i) const {
+        const ColumnStats& stats = catalog.columnStats(i);
+        double range = stats.max - stats.min;
+        return range > 0 ? static_cast<float>((sliderValues[i] - stats.min) / range) : 0.f;
+    }
+    
+    void setSliderFromMouse(int i, float mouseX) {
+        const ColumnStats& stats = catalog.columnStats(i);
+        float fraction = clamp((mouseX - SLIDER_X) / SLIDER_WIDTH, 0.f, 1.f);
+        sliderValues[i] = stats.min + fraction * (stats.max - stats.min);
+        sliderSeed = -1;
+        updateSliderTexts();
+        slidersChanged = true;
+    }
+    
+    // start the sliders at a song's features, or at the catalog average for -1
+    void seedSliders(int songIndex) {
+        if (songIndex >= 0) {
+            catalog.song(songIndex).rawFeatures(sliderValues);
+            sliderSeed = songIndex;
+        } else {
+            sliderSeed = -1;
+            for (int i = 0; i < NUM_FEATURES; ++i) {
+                sliderValues[i] = catalog.columnStats(i).mean;
+            }
+        }
+        updateSliderTexts();
+        slidersChanged = true;
+    }
+    
+    void updateSliderTexts() {
+        static const char* names[NUM_FEATURES] = {"Duration", "Energy", "Speechiness", "Acousticness",
+                                                  "Instrumentalness", "Valence", "Tempo"};
+        char label[64];
+        for (int i = 0; i < NUM_FEATURES; ++i) {
+            if (i == DURATION) {
+                int seconds = static_cast<int>(sliderValues[i] / 1000.0);
+                snprintf(label, sizeof(label), "%s  %d:%02d", names[i], seconds / 60, seconds % 60);
+            } else if (i == TEMPO) {
+                snprintf(label, sizeof(label), "%s  %.0f bpm", names[i], sliderValues[i]);
+            } else {
+                snprintf(label, sizeof(label), "%s  %.2f", names[i], sliderValues[i]);
+            }
+            sliderTexts[i].setString(label);
+        }
+    }
+    
+    // searches around the slider values, at most once per frame however many events came in.
+    // while dragging the target moves a little at a time so most of these are answered
+    // from the frontier of the last full search instead of looking at every song
+    // until a slider moves the target is the searched song itself, so it is left out like kNN does
+    void runSliderSearch() {
+        if (sliderSeed >= 0) {
+            catalog.kNearest(10, sliderSeed, results);
+        } else {
+            double target[NUM_FEATURES];
+            catalog.scaleFeatures(sliderValues, target);
+            sliderSearch.search(catalog, target, results);
+        }
+        updateResultsDisplay();
+        slidersChanged = false;
+        dirty = true;
+        layersDirty = true;
+    }
+    
+    // keep the cursor at the end of the typed text
+    void updateCursor() {
+        auto bounds = inputText.getGlobalBounds();
+        cursor.setPosition({bounds.position.x + bounds.size.x + 2.f, 160.f});
     }
     
     // figure out what songs match what the user typed
@@ -274,29 +499,41 @@ public:
             return;
         }
         
-        // make everything lowercase so we can search better
-        string lowerInput = userInput;
-        transform(lowerInput.begin(), lowerInput.end(), lowerInput.begin(), ::tolower);
+        // typo tolerant lookup in the precomputed index, so "bohemain" still finds bohemian rhapsody
+        for (int songIndex : fuzzyIndex.search(userInput, MAX_SUGGESTIONS)) {
+            currentSuggestions.push_back({catalog.song(songIndex).track, catalog.song(songIndex).artist});
+        }
         
-        // go through all the songs and find matches
-        for (const auto& [trackName, artistList] : trackArtistMap) {
-            string lowerTrack = trackName;
-            transform(lowerTrack.begin(), lowerTrack.end(), lowerTrack.begin(), ::tolower);
+        showSuggestions = !currentSuggestions.empty();
+        rebuildSuggestionTexts();
+    }
+    
+    // build the text and hit boxes for the suggestion list, only done when the suggestions change
+    void rebuildSuggestionTexts() {
+        suggestionBoxes.clear();
+        suggestionTexts.clear();
+        hoveredRow = -1;
+        
+        float suggestionHeight = 35.f;
+        for (size_t i = 0; i < currentSuggestions.size(); ++i) {
+            suggestionBoxes.push_back(sf::FloatRect({50.f, 192.f + static_cast<float>(i) * suggestionHeight},
+                                                    {500.f, suggestionHeight}));
             
-            // if the song name has what we typed in it, add it to suggestions
-            if (lowerTrack.find(lowerInput) != string::npos) {
-                // UPDATED: Add all versions of the song (different artists)
-                for (const auto& artistPair : artistList) {
-                    currentSuggestions.push_back({trackName, artistPair.first});
-                    
-                    if (currentSuggestions.size() >= MAX_SUGGESTIONS) break;
-                }
-                
-                if (currentSuggestions.size() >= MAX_SUGGESTIONS) break;
+            // the text showing the song and artist
+            sf::Text suggestionText(font);
+            string displayText = currentSuggestions[i].first + " - " + currentSuggestions[i].second;
+            
+            // cut it off if its too long
+            if (displayText.length() > 60) {
+                displayText = displayText.substr(0, 57) + "...";
             }
+            
+            suggestionText.setString(displayText);
+            suggestionText.setCharacterSize(16u);
+            suggestionText.setFillColor(sf::Color::White);
+            suggestionText.setPosition({60.f, 198.f + static_cast<float>(i) * suggestionHeight});
+            suggestionTexts.push_back(suggestionText);
         }
-        
-        showSuggestions = !currentSuggestions.empty();
     }
     
     // when someone picks a suggestion, fill it into the search box
@@ -308,13 +545,20 @@ public:
             userInput = selectedSongName + " - " + selectedArtistName;
             searchResults = make_pair(currentSuggestions[index].first, currentSuggestions[index].second);
             inputText.setString(userInput);
+            updateCursor();
             showSuggestions = false;
             selectedSuggestionIndex = -1;
         }
     }
     
     // handle typing, clicking, arrow keys, etc
+    // anything that changes what is on screen marks the frame dirty so it gets redrawn
     void handleInput(const sf::Event& event) {
+        // the window contents may have been lost
+        if (event.is<sf::Event::Resized>() || event.is<sf::Event::FocusGained>()) {
+            dirty = true;
+        }
+        
         // when someone types something
         if (event.is<sf::Event::TextEntered>() && searchBoxFocused && !dropdownOpen) {
             const auto& textEvent = *event.getIf<sf::Event::TextEntered>();
@@ -323,11 +567,14 @@ public:
                 // backspace - delete last character
                 userInput.pop_back();
                 inputText.setString(userInput);
+                updateCursor();
                 updateSuggestions();
             } else if (textEvent.unicode == 13) {
                 // enter key - either pick a suggestion or search
                 if (showSuggestions && selectedSuggestionIndex >= 0) {
                     selectSuggestion(selectedSuggestionIndex);
+                } else if (likedShown()) {
+                    performLikedSearch();
                 } else if (!userInput.empty()) {
                     performSearch(trackArtistMap);
                 }
@@ -335,8 +582,15 @@ public:
                 // regular character like a letter or number
                 userInput += static_cast<char>(textEvent.unicode);
                 inputText.setString(userInput);
+                updateCursor();
                 updateSuggestions();
             }
+            
+            // show the cursor right away while typing
+            showCursor = true;
+            cursorClock.restart();
+            dirty = true;
+            layersDirty = true;
         }
         
         // arrow keys to navigate suggestions
@@ -353,6 +607,40 @@ public:
                 showSuggestions = false;
                 selectedSuggestionIndex = -1;
             }
+            dirty = true;
+            layersDirty = true;
+        }
+        
+        // hovering only needs a redraw when the highlighted row changes
+        if (event.is<sf::Event::MouseMoved>()) {
+            sf::Vector2f mousePos = sf::Vector2f(event.getIf<sf::Event::MouseMoved>()->position);
+            if (activeSlider >= 0) {
+                setSliderFromMouse(activeSlider, mousePos.x);
+            }
+            const vector<sf::FloatRect>& rows = dropdownOpen ? optionBoxes : suggestionBoxes;
+            
+            int row = -1;
+            if (dropdownOpen || showSuggestions) {
+                for (size_t i = 0; i < rows.size(); ++i) {
+                    if (rows[i].contains(mousePos)) {
+                        row = static_cast<int>(i);
+                        break;
+                    }
+                }
+            }
+            
+            if (row != hoveredRow) {
+                hoveredRow = row;
+                dirty = true;
+                layersDirty = true;
+            }
+        }
+        
+        // letting go of a slider, the knob goes back to its normal color
+        if (event.is<sf::Event::MouseButtonReleased>() && activeSlider >= 0) {
+            activeSlider = -1;
+            dirty = true;
+            layersDirty = true;
         }
         
         // mouse clicks
@@ -362,8 +650,40 @@ public:
                 return;
             }
             
-            sf::Vector2f mousePos = sf::Vector2f(sf::Mouse::getPosition(window));
+            sf::Vector2f mousePos = sf::Vector2f(event.getIf<sf::Event::MouseButtonPressed>()->position);
             bool clickedAnywhere = false;
+            dirty = true;
+            layersDirty = true;
+            
+            // did they pick one of the algorithms in the open dropdown?
+            if (dropdownOpen) {
+                for (size_t i = 0; i < optionBoxes.size(); ++i) {
+                    if (optionBoxes[i].contains(mousePos)) {
+                        selectedAlgorithm = dropdownOptions[i];
+                        dropdownText.setString(selectedAlgorithm);
+                        dropdownOpen = false;
+                        if (slidersShown() && catalog.size() > 0) {
+                            slidersChanged = true;
+                        }
+                        hoveredRow = -1;
+                        clickClock.restart();
+                        return;
+                    }
+                }
+            }
+            
+            // grabbing one of the sliders
+            if (slidersShown() && !dropdownOpen && catalog.size() > 0) {
+                for (int i = 0; i < NUM_FEATURES; ++i) {
+                    if (sliderHitBox(i).contains(mousePos)) {
+                        activeSlider = i;
+                        setSliderFromMouse(i, mousePos.x);
+                        searchBoxFocused = false;
+                        showSuggestions = false;
+                        return;
+                    }
+                }
+            }
             
             // did they click the search box?
             if (searchBox.getGlobalBounds().contains(mousePos)) {
@@ -378,22 +698,39 @@ public:
             if (dropdownBox.getGlobalBounds().contains(mousePos)) {
                 dropdownOpen = !dropdownOpen;
                 showSuggestions = false;
+                hoveredRow = -1;
                 clickedAnywhere = true;
             }
             
             // did they click the search button?
-            if (searchButton.getGlobalBounds().contains(mousePos) && !userInput.empty()) {
-                performSearch(trackArtistMap);
+            if (searchButton.getGlobalBounds().contains(mousePos)) {
+                if (likedShown()) {
+                    performLikedSearch();
+                } else if (!userInput.empty()) {
+                    performSearch(trackArtistMap);
+                }
+                clickedAnywhere = true;
+            }
+            
+            // like or clear buttons for the liked songs
+            if (likeButton.getGlobalBounds().contains(mousePos)) {
+                if (!userInput.empty()) {
+                    likeSelectedSong();
+                }
+                clickedAnywhere = true;
+            }
+            if (clearButton.getGlobalBounds().contains(mousePos)) {
+                likedSongs.clear();
+                likedWeights.clear();
+                rebuildLikedTexts();
                 clickedAnywhere = true;
             }
             
             // did they click on one of the suggestions?
             if (showSuggestions) {
-                bool clickedSuggestion = false;
                 for (size_t i = 0; i < suggestionBoxes.size(); ++i) {
-                    if (suggestionBoxes[i].getGlobalBounds().contains(mousePos)) {
+                    if (suggestionBoxes[i].contains(mousePos)) {
                         selectSuggestion(i);
-                        clickedSuggestion = true;
                         clickedAnywhere = true;
                         clickClock.restart();
                         break;
@@ -421,10 +758,20 @@ public:
         return;
         }    
         
-        if (selectedAlgorithm == "K-Nearest Neighbors") {
-            results = kNearestNeighbors(10,queryIndex, allSongs);
+        const song_data& querySong = catalog.song(queryIndex);
+        cout << "Found song: " << querySong.track << " by " << querySong.artist << endl;
+        
+        if (slidersShown()) {
+            // start tuning from the song that was searched
+            seedSliders(queryIndex);
+            runSliderSearch();
+        } else if (selectedAlgorithm == "K-Nearest Neighbors") {
+            catalog.kNearest(10, queryIndex, results);
         } else {
-            results = rNN(allSongs,allSongs[queryIndex],0.220);
+            catalog.radius(queryIndex, 0.220, results);
+            if (results.empty()) {
+                cout << "Less than 10 matches found" << endl;
+            }
         }
         
         updateResultsDisplay();
@@ -450,9 +797,15 @@ public:
         for (size_t i = 0; i < results.size(); ++i) {
             sf::Text result(font);
             
-            string resultStr = to_string(i + 1) + ". " + 
-                              results[i].trackName + " - " + 
-                              results[i].artist + " (" + 
+            // the names are only looked up now that they are shown
+            const song_data& song = catalog.song(results[i].index);
+            string name = song.track + " - " + song.artist;
+            
+            // the sliders or liked songs take up the right side of the panel
+            if ((slidersShown() || likedShown()) && name.length() > 45) {
+                name = name.substr(0, 42) + "...";
+            }
+            string resultStr = to_string(i + 1) + ". " + name + " (" +
                               to_string(static_cast<int>(results[i].similarity * 100)) + "% match)";
             
             result.setString(resultStr);
@@ -465,168 +818,169 @@ public:
         }
     }
     
-    // draw the algorithm selection dropdown
-    void drawDropdownOptions() {
-        vector<string> options = {"K-Nearest Neighbors", "Radius Nearest Neighbors"};
-        
-        for (size_t i = 0; i < options.size(); ++i) {
-            sf::RectangleShape optionBox;
-            optionBox.setSize({300.f, 40.f});
-            optionBox.setPosition({600.f, 190.f + static_cast<float>(i) * 40.f});
-            optionBox.setFillColor(sf::Color(70u, 70u, 70u));
-            optionBox.setOutlineColor(sf::Color(100u, 100u, 100u));
-            optionBox.setOutlineThickness(1.f);
-            
-            sf::Text optionText(font);
-            optionText.setString(options[i]);
-            optionText.setCharacterSize(18u);
-            optionText.setFillColor(sf::Color::White);
-            optionText.setPosition({610.f, 198.f + static_cast<float>(i) * 40.f});
-            
-            sf::Vector2f mousePos = sf::Vector2f(sf::Mouse::getPosition(window));
-            if (optionBox.getGlobalBounds().contains(mousePos)) {
-                optionBox.setFillColor(sf::Color(100u, 100u, 100u));
-                
-                if (sf::Mouse::isButtonPressed(sf::Mouse::Button::Left)) {
-                    selectedAlgorithm = options[i];
-                    dropdownText.setString(selectedAlgorithm);
-                    dropdownOpen = false;
-                }
+    // rebuild the batched boxes, only called when layersDirty is set
+    void rebuildLayers() {
+        baseLayer.clear();
+        sf::Color border(100u, 100u, 100u);
+        
+        // change the search box color based on if its selected
+        sf::Color searchOutline = searchBoxFocused ? sf::Color(30u, 215u, 96u) : border;
+        appendRect(baseLayer, {searchBox.getPosition(), searchBox.getSize()}, sf::Color(50u, 50u, 50u), searchOutline, 2.f);
+        appendRect(baseLayer, {dropdownBox.getPosition(), dropdownBox.getSize()}, sf::Color(50u, 50u, 50u), border, 2.f);
+        appendRect(baseLayer, {searchButton.getPosition(), searchButton.getSize()}, sf::Color(30u, 215u, 96u));
+        appendRect(baseLayer, {likeButton.getPosition(), likeButton.getSize()}, sf::Color(50u, 50u, 50u), border, 2.f);
+        appendRect(baseLayer, {clearButton.getPosition(), clearButton.getSize()}, sf::Color(50u, 50u, 50u), border, 2.f);
+        appendRect(baseLayer, {resultsPanel.getPosition(), resultsPanel.getSize()}, sf::Color(30u, 30u, 30u), border, 2.f);
+        
+        if (slidersShown() && catalog.size() > 0) {
+            for (int i = 0; i < NUM_FEATURES; ++i) {
+                sf::FloatRect track = sliderTrack(i);
+                float knobX = track.position.x + sliderFraction(i) * track.size.x;
+                sf::Color knob = (i == activeSlider) ? sf::Color::White : sf::Color(30u, 215u, 96u);
+                appendRect(baseLayer, track, sf::Color(70u, 70u, 70u));
+                appendRect(baseLayer, sf::FloatRect({knobX - 6.f, track.position.y - 7.f}, {12.f, 20.f}), knob);
+            }
+        }
+        
+        overlayLayer.clear();
+        if (dropdownOpen) {
+            // the algorithm selection dropdown
+            for (size_t i = 0; i < optionBoxes.size(); ++i) {
+                bool isHovered = (static_cast<int>(i) == hoveredRow);
+                sf::Color fill = isHovered ? sf::Color(100u, 100u, 100u) : sf::Color(70u, 70u, 70u);
+                appendRect(overlayLayer, optionBoxes[i], fill, border, 1.f);
+            }
+        } else if (showSuggestions && !currentSuggestions.empty()) {
+            // the container for all suggestions
+            float totalHeight = 35.f * currentSuggestions.size();
+            appendRect(overlayLayer, sf::FloatRect({50.f, 192.f}, {500.f, totalHeight}), sf::Color(40u, 40u, 40u), border, 2.f);
+            
+            // highlight a suggestion if mouse is over it or if its selected with arrow keys
+            for (size_t i = 0; i < suggestionBoxes.size(); ++i) {
+                bool isHovered = (static_cast<int>(i) == hoveredRow);
+                bool isSelected = (static_cast<int>(i) == selectedSuggestionIndex);
+                sf::Color fill = (isSelected || isHovered) ? sf::Color(70u, 70u, 70u) : sf::Color(45u, 45u, 45u);
+                appendRect(overlayLayer, suggestionBoxes[i], fill);
             }
-            
-            window.draw(optionBox);
-            window.draw(optionText);
         }
     }
     
-    // draw the autocomplete suggestions dropdown
-    void drawSuggestions() {
-        if (!showSuggestions || currentSuggestions.empty()) return;
-        
-        suggestionBoxes.clear();
-        suggestionTexts.clear();
-        
-        float suggestionHeight = 35.f;
-        float totalHeight = suggestionHeight * currentSuggestions.size();
+    // draw the whole retained scene
+    // a cursor blink or a lost window only redraws, the boxes are rebuilt when they changed
+    void render() {
+        if (layersDirty) {
+            rebuildLayers();
+            layersDirty = false;
+        }
         
-        // draw the container for all suggestions
-        suggestionsBox.setSize({500.f, totalHeight});
-        suggestionsBox.setPosition({50.f, 192.f});
-        window.draw(suggestionsBox);
+        window.clear(sf::Color(18u, 18u, 18u));
+        
+        window.draw(baseLayer);
+        window.draw(titleText);
+        window.draw(searchLabel);
+        window.draw(inputText);
+        window.draw(algorithmLabel);
+        window.draw(dropdownText);
+        window.draw(buttonText);
+        window.draw(likeText);
+        window.draw(clearText);
+        
+        // draw the blinking cursor
+        if (searchBoxFocused && showCursor) {
+            window.draw(cursor);
+        }
         
-        // figure out where the mouse is
-        sf::Vector2f mousePos = sf::Vector2f(sf::Mouse::getPosition(window));
+        // draw the search results
+        for (const auto& text : resultTexts) {
+            window.draw(text);
+        }
+        if (slidersShown() && catalog.size() > 0) {
+            for (const auto& text : sliderTexts) {
+                window.draw(text);
+            }
+        }
+        if (likedShown()) {
+            for (const auto& text : likedTexts) {
+                window.draw(text);
+            }
+        }
         
-        // draw each individual suggestion
-        for (size_t i = 0; i < currentSuggestions.size(); ++i) {
-            sf::RectangleShape suggestionBox;
-            suggestionBox.setSize({500.f, suggestionHeight});
-            suggestionBox.setPosition({50.f, 192.f + static_cast<float>(i) * suggestionHeight});
-            
-            // highlight it if mouse is over it or if its selected with arrow keys
-            bool isHovered = suggestionBox.getGlobalBounds().contains(mousePos);
-            bool isSelected = (i == selectedSuggestionIndex);
-            
-            if (isSelected || isHovered) {
-                suggestionBox.setFillColor(sf::Color(70u, 70u, 70u));
-            } else {
-                suggestionBox.setFillColor(sf::Color(45u, 45u, 45u));
+        // the open dropdown or the autocomplete suggestions go on top of everything
+        window.draw(overlayLayer);
+        if (dropdownOpen) {
+            for (const auto& text : optionTexts) {
+                window.draw(text);
             }
-            
-            suggestionBoxes.push_back(suggestionBox);
-            window.draw(suggestionBox);
-            
-            // draw the text showing the song and artist
-            sf::Text suggestionText(font);
-            string displayText = currentSuggestions[i].first + " - " + currentSuggestions[i].second;
-            
-            // cut it off if its too long
-            if (displayText.length() > 60) {
-                displayText = displayText.substr(0, 57) + "...";
+        } else if (showSuggestions) {
+            for (const auto& text : suggestionTexts) {
+                window.draw(text);
             }
-            
-            suggestionText.setString(displayText);
-            suggestionText.setCharacterSize(16u);
-            suggestionText.setFillColor(sf::Color::White);
-            suggestionText.setPosition({60.f, 198.f + static_cast<float>(i) * suggestionHeight});
-            
-            suggestionTexts.push_back(suggestionText);
-            window.draw(suggestionText);
         }
+        
+        window.display();
     }
     
     // main loop that keeps everything running
+    // nothing is redrawn unless an event or the cursor blink changed something,
+    // so while idle the thread just sleeps in waitEvent
     void run() {
         while (window.isOpen()) {
-            while (const optional event = window.pollEvent()) {
+            // only wake up for the cursor blink when the cursor is actually visible
+            sf::Time timeout = sf::Time::Zero; // zero means wait until there is an event
+            if (searchBoxFocused) {
+                timeout = CURSOR_BLINK - cursorClock.getElapsedTime();
+                if (timeout < sf::milliseconds(1)) {
+                    timeout = sf::milliseconds(1);
+                }
+            }
+            
+            if (const optional event = window.waitEvent(timeout)) {
                 if (event->is<sf::Event::Closed>()) {
                     window.close();
+                    break;
                 }
-                
                 handleInput(*event);
+                
+                // handle anything else that queued up before drawing
+                while (const optional next = window.pollEvent()) {
+                    if (next->is<sf::Event::Closed>()) {
+                        window.close();
+                        break;
+                    }
+                    handleInput(*next);
+                }
+            }
+            
+            // one search for however many slider moves queued up
+            if (slidersChanged && slidersShown()) {
+                runSliderSearch();
             }
             
             // make the cursor blink
-            if (cursorClock.getElapsedTime().asSeconds() > 0.5f) {
+            if (cursorClock.getElapsedTime() >= CURSOR_BLINK) {
                 showCursor = !showCursor;
                 cursorClock.restart();
+                if (searchBoxFocused) {
+                    dirty = true;
+                }
             }
             
-            // change the search box color based on if its selected
-            if (searchBoxFocused) {
-                searchBox.setOutlineColor(sf::Color(30u, 215u, 96u));
-            } else {
-                searchBox.setOutlineColor(sf::Color(100u, 100u, 100u));
-            }
-            
-            // clear the screen and start drawing
-            window.clear(sf::Color(18u, 18u, 18u));
-            
-            window.draw(titleText);
-            window.draw(searchLabel);
-            window.draw(searchBox);
-            window.draw(inputText);
-            
-            // draw the blinking cursor
-            if (searchBoxFocused && showCursor) {
-                sf::RectangleShape cursor;
-                cursor.setSize({2.f, 20.f});
-                auto bounds = inputText.getGlobalBounds();
-                float cursorX = bounds.position.x + bounds.size.x + 2.f;
-                cursor.setPosition({cursorX, 160.f});
-                cursor.setFillColor(sf::Color::White);
-                window.draw(cursor);
-            }
-            
-            window.draw(algorithmLabel);
-            window.draw(dropdownBox);
-            window.draw(dropdownText);
-            window.draw(searchButton);
-            window.draw(buttonText);
-            window.draw(resultsPanel);
-            
-            // draw the algorithm dropdown if its open
-            if (dropdownOpen) {
-                drawDropdownOptions();
-            }
-            
-            // draw autocomplete suggestions if there are any
-            if (showSuggestions && !dropdownOpen) {
-                drawSuggestions();
-            }
-            
-            // draw the search results
-            for (const auto& text : resultTexts) {
-                window.draw(text);
+            if (dirty && window.isOpen()) {
+                render();
+                dirty = false;
             }
-            
-            window.display();
         }
     }
 };
 
 // main entry point - creates the UI and runs it
 int main(int argc, char* argv[]) {
+    // block store commands run without a window, for catalogs too big to load
+    int storeResult = runStoreCommand(argc, argv);
+    if (storeResult >= 0) {
+        return storeResult;
+    }
+
     // create and run the UI (data loading happens in the constructor)
     MelodyMapUI app(argv[0]);
     app.run();
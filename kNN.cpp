@@ -0,0 +1,99 @@
+#include "kNN.h"
+#include "rNN.h" // for songDistanceSquare
+using namespace std;
+
+double getInverseSim(double distance){
+    return 1.0 / (1.0 + distance);
+}
+
+void kNearestNeighbors(const Shard& shard, const double* search, int skipTrack, TopK& best){
+    // loop through every song and calculate how far it is from the query song
+    // only songs closer than the current kth best are offered, which is most of the time none
+    for (int i = 0; i < shard.songs.size(); i++){
+        // skip the query song itself (including any duplicate entries with same name)
+        if (shard.trackIds[i] == skipTrack) continue;
+        double distSquare = songDistanceSquare(search, shard.features.row(i));
+        if (distSquare < best.bound()){
+            best.offer({shard.globalIndex(i), shard.trackIds[i], distSquare});
+        }
+    }
+}
+
+void nearestSongs(const Shard& shard, const double* search, size_t count, std::pmr::vector<Neighbor>& heap){
+    auto closer = [](const Neighbor& a, const Neighbor& b){ return a.distSquare < b.distSquare; };
+    heap.clear();
+    if (count == 0){
+        return;
+    }
+    for (int i = 0; i < shard.songs.size(); i++){
+        double distSquare = songDistanceSquare(search, shard.features.row(i));
+        if (heap.size() < count){
+            heap.push_back({shard.globalIndex(i), shard.trackIds[i], distSquare});
+            push_heap(heap.begin(), heap.end(), closer);
+        }
+        else if (distSquare < heap.front().distSquare){
+            pop_heap(heap.begin(), heap.end(), closer);
+            heap.back() = {shard.globalIndex(i), shard.trackIds[i], distSquare};
+            push_heap(heap.begin(), heap.end(), closer);
+        }
+    }
+}
+
+IncrementalKNN::IncrementalKNN(int k, size_t frontierSize)
+    : k(k), frontierSize(frontierSize ? frontierSize : 32 * k) {
+    frontier.reserve(this->frontierSize + 1);
+    frontierRows.reserve(this->frontierSize);
+}
+
+bool IncrementalKNN::searchFrontier(const double* target, double delta, vector<SongResult>& results){
+    ArenaScope scope;
+    TopK best(k, numeric_limits<double>::infinity(), scope.resource());
+    for (size_t i = 0; i < frontier.size(); i++){
+        double distSquare = songDistanceSquare(target, frontierRows[i]);
+        if (distSquare < best.bound()){
+            best.offer({frontier[i].index, frontier[i].trackId, distSquare});
+        }
+    }
+
+    // every song outside the frontier is at least frontierRadius - delta from the target
+    // (an infinite radius means the frontier is the whole catalog)
+    bool exact = isinf(frontierRadius) ||
+                 (best.items.size() == k && sqrt(best.bound()) <= frontierRadius - delta);
+    if (!exact){
+        return false;
+    }
+    results.clear();
+    for (const auto& n : best.items){
+        results.emplace_back(n.index, getInverseSim(sqrt(n.distSquare)));
+    }
+    return true;
+}
+
+void IncrementalKNN::search(Catalog& catalog, const double* target, vector<SongResult>& results){
+    if (hasAnchor && searchFrontier(target, sqrt(songDistanceSquare(target, anchor)), results)){
+        hits++;
+        return;
+    }
+    misses++;
+
+    // rebuild the frontier around the new target, one more song than kept so its radius is known
+    catalog.nearestSongs(target, frontierSize + 1, frontier);
+    if (frontier.size() > frontierSize){
+        frontierRadius = sqrt(frontier.back().distSquare);
+        frontier.pop_back();
+    }
+    else {
+        frontierRadius = numeric_limits<double>::infinity();
+    }
+    frontierRows.clear();
+    for (const auto& n : frontier){
+        frontierRows.push_back(catalog.featureRow(n.index));
+    }
+    copy(target, target + NUM_FEATURES, anchor);
+    hasAnchor = true;
+
+    // with lots of duplicate versions the frontier might not have k different tracks
+    if (!searchFrontier(target, 0, results)){
+        catalog.kNearestTo(k, target, results);
+    }
+}
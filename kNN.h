@@ -0,0 +1,55 @@
+// this is for the k nearest neighbors algorithm
+#pragma once
+#include "catalog.h"
+
+/*
+k nearest neighbors on one shard.
+offers every song of the shard to best (which keeps the closest k, one per track name)
+songs with the track id skipTrack are skipped so the search song and its duplicates don't show up
+*/
+void kNearestNeighbors(const Shard& shard, const double* search, int skipTrack, TopK& best);
+
+// similarity used for the knn results, 1 for the same song and approaching 0 the further away
+double getInverseSim(double distance);
+
+/*
+the count nearest songs of one shard to search, duplicates included.
+heap is kept as a max heap on distance so the furthest one can be swapped out quickly
+*/
+void nearestSongs(const Shard& shard, const double* search, size_t count, std::pmr::vector<Neighbor>& heap);
+
+/*
+kNN for a target that moves a little at a time, like when dragging a slider.
+A full search keeps a frontier of the closest songs to where the target was (the anchor).
+If the target has only moved delta since then, every song outside the frontier is still at least
+frontierRadius - delta away, so when the kth best song inside the frontier is closer than that
+the answer is exact and only the frontier has to be looked at. Otherwise it searches again from the new spot.
+*/
+class IncrementalKNN {
+public:
+    explicit IncrementalKNN(int k = 10, size_t frontierSize = 0);
+
+    // the k nearest songs to target (in the scaled feature space) like Catalog::kNearestTo
+    void search(Catalog& catalog, const double* target, std::vector<SongResult>& results);
+
+    // forget the frontier, the next search does a full pass (call it when the catalog changes)
+    void reset() { hasAnchor = false; }
+
+    // how many searches were answered from the frontier and how many needed a full pass
+    size_t frontierHits() const { return hits; }
+    size_t fullSearches() const { return misses; }
+
+private:
+    int k;
+    size_t frontierSize;
+    bool hasAnchor = false;
+    double anchor[NUM_FEATURES];
+    std::vector<Neighbor> frontier;
+    std::vector<const double*> frontierRows; // feature row of each frontier song
+    double frontierRadius = 0; // distance from the anchor to the closest song not in the frontier
+    size_t hits = 0;
+    size_t misses = 0;
+
+    // the k best songs in the frontier for target, returns false if it can't prove they are the real k best
+    bool searchFrontier(const double* target, double delta, std::vector<SongResult>& results);
+};
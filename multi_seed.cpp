@@ -0,0 +1,240 @@
+#include "multi_seed.h"
+#include "rNN.h" // for songDistanceSquare
+using namespace std;
+
+void SeedQuery::prepare(const Catalog& catalog, const vector<int>& seedSongs, const vector<double>& seedWeights,
+                        SeedAggregate aggregate){
+    this->aggregate = aggregate;
+    size_t count = seedSongs.size();
+    pmr::memory_resource* resource = seeds.get_allocator().resource();
+
+    // equal weights unless Weighted was asked for with usable ones
+    pmr::vector<double> w(count, 1.0, resource);
+    if (aggregate == SeedAggregate::Weighted && seedWeights.size() == count){
+        for (size_t j = 0; j < count; j++){
+            w[j] = max(0.0, seedWeights[j]);
+        }
+    }
+    double total = 0;
+    for (double x : w){
+        total += x;
+    }
+    if (total <= 0){
+        fill(w.begin(), w.end(), 1.0);
+        total = count;
+    }
+
+    // seeds next to each other on the hilbert curve are close, so the curve is cut into the groups
+    pmr::vector<int> order(count, resource);
+    pmr::vector<uint64_t> keys(count, resource);
+    double low[NUM_FEATURES], high[NUM_FEATURES];
+    for (int c = 0; c < NUM_FEATURES; c++){
+        low[c] = numeric_limits<double>::infinity();
+        high[c] = -numeric_limits<double>::infinity();
+        for (int song : seedSongs){
+            low[c] = min(low[c], catalog.featureRow(song)[c]);
+            high[c] = max(high[c], catalog.featureRow(song)[c]);
+        }
+    }
+    const uint32_t cells = uint32_t(1) << CURVE_BITS;
+    for (size_t j = 0; j < count; j++){
+        const double* row = catalog.featureRow(seedSongs[j]);
+        uint32_t coords[NUM_FEATURES];
+        for (int c = 0; c < NUM_FEATURES; c++){
+            double range = high[c] - low[c];
+            double t = (range > 0) ? (row[c] - low[c]) / range : 0;
+            coords[c] = min<uint32_t>(cells - 1, static_cast<uint32_t>(t * cells));
+        }
+        keys[j] = hilbertKey(coords);
+        order[j] = j;
+    }
+    sort(order.begin(), order.end(), [&](int a, int b){ return keys[a] < keys[b]; });
+
+    seeds.clear();
+    weights.clear();
+    skipTracks.clear();
+    for (int j : order){
+        const double* row = catalog.featureRow(seedSongs[j]);
+        seeds.insert(seeds.end(), row, row + NUM_FEATURES);
+        weights.push_back(w[j] / total);
+        skipTracks.push_back(catalog.trackId(seedSongs[j]));
+    }
+    sort(skipTracks.begin(), skipTracks.end());
+
+    for (int c = 0; c < NUM_FEATURES; c++){
+        centroid[c] = 0;
+        for (size_t j = 0; j < count; j++){
+            centroid[c] += weights[j] * seeds[j * NUM_FEATURES + c];
+        }
+    }
+
+    groups.clear();
+    if (aggregate == SeedAggregate::Min){
+        return; // the groups only bound Mean/Weighted scores
+    }
+    size_t groupSize = max<size_t>(static_cast<size_t>(ceil(sqrt(static_cast<double>(count)))),
+                                   (count + MAX_SEED_GROUPS - 1) / MAX_SEED_GROUPS);
+    for (size_t begin = 0; begin < count; begin += groupSize){
+        SeedGroup group;
+        group.begin = begin;
+        group.end = min(count, begin + groupSize);
+        group.weight = 0;
+        for (int j = group.begin; j < group.end; j++){
+            group.weight += weights[j];
+        }
+        for (int c = 0; c < NUM_FEATURES; c++){
+            group.center[c] = 0;
+            for (int j = group.begin; j < group.end; j++){
+                // a group of zero weight seeds adds nothing to the score, the plain average just gives it a center
+                double share = (group.weight > 0) ? weights[j] / group.weight : 1.0 / (group.end - group.begin);
+                group.center[c] += share * seeds[j * NUM_FEATURES + c];
+            }
+        }
+        groups.push_back(group);
+    }
+}
+
+double SeedQuery::score(const double* song, double bound) const {
+    // the average distance can't be below the distance to the centroid (triangle inequality)
+    if (sqrt(songDistanceSquare(song, centroid)) >= bound){
+        return bound;
+    }
+
+    // the same per group, tighter but sqrt(seeds) distances
+    double groupBound[MAX_SEED_GROUPS];
+    double sum = 0;
+    for (size_t g = 0; g < groups.size(); g++){
+        groupBound[g] = groups[g].weight * sqrt(songDistanceSquare(song, groups[g].center));
+        sum += groupBound[g];
+    }
+
+    // swap each group's bound for its exact part until the song is out or done
+    for (size_t g = 0; g < groups.size() && sum < bound; g++){
+        double exact = 0;
+        for (int j = groups[g].begin; j < groups[g].end; j++){
+            exact += weights[j] * sqrt(songDistanceSquare(song, &seeds[j * NUM_FEATURES]));
+        }
+        sum += exact - groupBound[g];
+    }
+    return sum;
+}
+
+// distance from a box to the closest of the seeds, nothing in the box can score under it
+static double closestSeed(const FeatureBox& box, const pmr::vector<const double*>& seeds){
+    double closest = numeric_limits<double>::infinity();
+    for (const double* seed : seeds){
+        closest = min(closest, boxDistanceSquare(box, seed));
+    }
+    return sqrt(closest);
+}
+
+// the seeds in from that are closer than bound to box, the only ones that matter for its songs
+static void seedsNear(const FeatureBox& box, const pmr::vector<const double*>& from, double bound,
+                      pmr::vector<const double*>& near){
+    near.clear();
+    for (const double* seed : from){
+        if (boxDistanceSquare(box, seed) < bound * bound){
+            near.push_back(seed);
+        }
+    }
+}
+
+/*
+Min goes through the boxes of the shard instead of song by song. The super boxes are sorted by
+their distance to the closest seed and visited closest first, inside one its boxes are too, and
+the kth best drops quickly so most of the shard is ruled out a super box at a time.
+Each level only compares against the seeds that reached into the level above, so the full seed list
+is only looked at once per super box
+*/
+static void minSeedNearest(const Shard& shard, const SeedQuery& query, SeedScratch& scratch, TopK& best){
+    const pmr::vector<const double*>& allSeeds = scratch.allSeeds;
+    pmr::vector<const double*>& superNear = scratch.superNear;
+    pmr::vector<const double*>& boxNear = scratch.boxNear;
+
+    pmr::vector<pair<double,int>>& supers = scratch.supers;
+    supers.clear();
+    for (int s = 0; s < shard.superBoxes.size(); s++){
+        supers.emplace_back(closestSeed(shard.superBoxes[s], allSeeds), s);
+    }
+    sort(supers.begin(), supers.end());
+
+    pmr::vector<pair<double,int>>& boxes = scratch.boxes;
+    for (const auto& [superGap, s] : supers){
+        if (superGap >= sqrt(best.bound())){
+            break; // every super box after this one is further away
+        }
+        seedsNear(shard.superBoxes[s], allSeeds, sqrt(best.bound()), superNear);
+
+        boxes.clear();
+        int boxEnd = min<int>(shard.boxes.size(), (s + 1) * SUPER_BOX_BOXES);
+        for (int b = s * SUPER_BOX_BOXES; b < boxEnd; b++){
+            boxes.emplace_back(closestSeed(shard.boxes[b], superNear), b);
+        }
+        sort(boxes.begin(), boxes.end());
+
+        for (const auto& [boxGap, b] : boxes){
+            if (boxGap >= sqrt(best.bound())){
+                break;
+            }
+            seedsNear(shard.boxes[b], superNear, sqrt(best.bound()), boxNear);
+
+            int end = min<int>(shard.songs.size(), (b + 1) * SHARD_BOX_SONGS);
+            for (int i = b * SHARD_BOX_SONGS; i < end; i++){
+                // each distance is given up as soon as it passes the closest seed so far
+                const double* song = shard.features.row(i);
+                double closestSquare = best.bound();
+                for (const double* seed : boxNear){
+                    double distSquare = 0;
+                    for (int c = 0; c < NUM_FEATURES && distSquare < closestSquare; c++){
+                        double diff = song[c] - seed[c];
+                        distSquare += diff * diff;
+                    }
+                    closestSquare = min(closestSquare, distSquare);
+                }
+                if (closestSquare >= best.bound()){
+                    continue;
+                }
+                // the seeds themselves and other versions of them are never recommended
+                if (binary_search(query.skipTracks.begin(), query.skipTracks.end(), shard.trackIds[i])){
+                    continue;
+                }
+                best.offer({shard.globalIndex(i), shard.trackIds[i], closestSquare});
+            }
+        }
+    }
+}
+
+SeedScratch::SeedScratch(const SeedQuery& query, const Shard& shard, pmr::memory_resource* resource)
+    : allSeeds(resource), superNear(resource), boxNear(resource), supers(resource), boxes(resource) {
+    if (query.aggregate != SeedAggregate::Min){
+        return; // only Min goes through the boxes
+    }
+    size_t seedCount = query.weights.size();
+    allSeeds.reserve(seedCount);
+    for (size_t j = 0; j < seedCount; j++){
+        allSeeds.push_back(&query.seeds[j * NUM_FEATURES]);
+    }
+    superNear.reserve(seedCount);
+    boxNear.reserve(seedCount);
+    supers.reserve(shard.superBoxes.size());
+    boxes.reserve(SUPER_BOX_BOXES);
+}
+
+void multiSeedNearest(const Shard& shard, const SeedQuery& query, SeedScratch& scratch, TopK& best){
+    if (query.aggregate == SeedAggregate::Min){
+        minSeedNearest(shard, query, scratch, best);
+        return;
+    }
+    for (int i = 0; i < shard.songs.size(); i++){
+        double bound = sqrt(best.bound());
+        double score = query.score(shard.features.row(i), bound);
+        if (score >= bound){
+            continue;
+        }
+        // the seeds themselves and other versions of them are never recommended
+        if (binary_search(query.skipTracks.begin(), query.skipTracks.end(), shard.trackIds[i])){
+            continue;
+        }
+        best.offer({shard.globalIndex(i), shard.trackIds[i], score * score});
+    }
+}
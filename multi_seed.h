@@ -0,0 +1,74 @@
+// recommendations from a whole set of liked songs at once
+#pragma once
+#include "catalog.h"
+
+/*
+How the distances from a song to each seed are combined into one score
+Min      - distance to the closest seed, finds songs like any one of them
+Mean     - average distance to all the seeds, finds songs that fit the whole set
+Weighted - same as mean but each seed counts as much as its weight
+*/
+enum class SeedAggregate { Min, Mean, Weighted };
+
+// at most this many seed groups, bigger sets get bigger groups
+const int MAX_SEED_GROUPS = 64;
+
+// a few seeds that are close together so their part of a Mean/Weighted score can be bounded all at once
+struct SeedGroup {
+    double center[NUM_FEATURES]; // weighted centroid of the group
+    double weight; // total weight of the group
+    int begin;     // seeds begin .. end - 1 of the query
+    int end;
+};
+
+/*
+Everything a multi seed search needs, worked out once per query before the shards are scanned.
+The seeds are sorted along a hilbert curve and cut into about sqrt(seeds) groups of nearby seeds.
+For Mean/Weighted a candidate's score can't be lower than what the bounds say, so most songs are
+thrown out after looking at the groups instead of every seed: the weighted average distance to some
+seeds is at least the distance to their weighted centroid, first for all the seeds at once and then
+per group. Groups are swapped for their exact sum one at a time until the song is either out or fully scored.
+Min only uses the seeds, multiSeedNearest checks them against the shard's boxes instead (see there)
+*/
+struct SeedQuery {
+    SeedAggregate aggregate;
+    std::pmr::vector<double> seeds;     // NUM_FEATURES per seed, in group order
+    std::pmr::vector<double> weights;   // one per seed, adding up to 1
+    std::pmr::vector<int> skipTracks;   // track ids of the seeds, sorted
+    std::pmr::vector<SeedGroup> groups;
+    double centroid[NUM_FEATURES];
+
+    explicit SeedQuery(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : seeds(resource), weights(resource), skipTracks(resource), groups(resource) {}
+
+    // weights can be empty (every seed counts the same), they are only used by Weighted
+    void prepare(const Catalog& catalog, const std::vector<int>& seedSongs, const std::vector<double>& seedWeights,
+                 SeedAggregate aggregate);
+
+    // the Mean/Weighted score of a song (a distance), or anything >= bound if it can't get under bound
+    double score(const double* song, double bound) const;
+};
+
+/*
+Scratch space for one shard's Min scan, taken from the arena of the thread that starts the search and
+reserved up front (like the per shard TopKs) so the workers scanning the shards never allocate
+*/
+struct SeedScratch {
+    std::pmr::vector<const double*> allSeeds; // every seed of the query
+    std::pmr::vector<const double*> superNear; // the seeds reaching into the current super box
+    std::pmr::vector<const double*> boxNear;   // and into the current box
+    std::pmr::vector<std::pair<double,int>> supers; // (distance to the closest seed, super box)
+    std::pmr::vector<std::pair<double,int>> boxes;  // the same for the boxes of one super box
+
+    SeedScratch(const SeedQuery& query, const Shard& shard,
+                std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+};
+
+/*
+multi seed search on one shard, every song that isn't one of the seeds (or a version of their tracks)
+and scores under the current kth best is offered to best with distSquare = score * score.
+Min walks the shard's super boxes and boxes closest first against the seeds that reach them,
+so only the neighbourhoods of the seeds are read. Every seed still has to be checked against the
+super boxes since the best song could be next to any one of them
+*/
+void multiSeedNearest(const Shard& shard, const SeedQuery& query, SeedScratch& scratch, TopK& best);
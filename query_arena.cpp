@@ -0,0 +1,57 @@
+#include "query_arena.h"
+#include <cstdint>
+#include <new>
+using namespace std;
+
+// starting size of every thread's block, grown as needed
+const size_t INITIAL_ARENA_BYTES = 64 * 1024;
+
+QueryArena& QueryArena::local(){
+    static thread_local QueryArena arena;
+    return arena;
+}
+
+void* QueryArena::do_allocate(size_t bytes, size_t alignment){
+    if (!block){
+        capacity = INITIAL_ARENA_BYTES;
+        block = make_unique<byte[]>(capacity);
+    }
+
+    uintptr_t base = reinterpret_cast<uintptr_t>(block.get());
+    uintptr_t aligned = (base + used + alignment - 1) & ~(uintptr_t(alignment) - 1);
+    size_t end = (aligned - base) + bytes;
+    if (end <= capacity){
+        used = end;
+        highWater = max(highWater, used + overflowBytes);
+        return reinterpret_cast<void*>(aligned);
+    }
+
+    // doesn't fit, borrow from the heap until the scope ends
+    void* memory = ::operator new(bytes, align_val_t(alignment));
+    overflow.emplace_back(memory, alignment);
+    overflowBytes += bytes + alignment;
+    overflowCount++;
+    highWater = max(highWater, used + overflowBytes);
+    return memory;
+}
+
+ArenaScope::ArenaScope() : arena(QueryArena::local()), mark(arena.used) {
+    arena.depth++;
+}
+
+ArenaScope::~ArenaScope(){
+    arena.used = mark;
+    arena.depth--;
+    if (arena.depth > 0 || arena.overflow.empty()){
+        return;
+    }
+
+    // the outermost search is done, give the memory back and grow the block so it fits next time
+    for (const auto& [memory, alignment] : arena.overflow){
+        ::operator delete(memory, align_val_t(alignment));
+    }
+    arena.overflow.clear();
+    arena.overflowBytes = 0;
+    arena.capacity = max(arena.capacity * 2, arena.highWater);
+    arena.block = make_unique<byte[]>(arena.capacity);
+}
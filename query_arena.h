@@ -0,0 +1,56 @@
+// per thread scratch memory so searches don't hit the heap
+#pragma once
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+/*
+Bump allocator that every search takes its temporary buffers from.
+There is one per thread and it is never freed, a search just rewinds it when it's done.
+If a search needs more than the block holds, the extra comes from the heap once and the block
+is grown to fit when the outermost search finishes, so after the first few searches
+the same block is reused and no heap allocations happen at all.
+Use it through ArenaScope and std::pmr containers.
+*/
+class QueryArena : public std::pmr::memory_resource {
+public:
+    // the arena of the calling thread
+    static QueryArena& local();
+
+    // how many times a search had to fall back to the heap, for checking the steady state
+    size_t heapAllocations() const { return overflowCount; }
+
+private:
+    friend class ArenaScope;
+
+    std::unique_ptr<std::byte[]> block;
+    size_t capacity = 0;
+    size_t used = 0;
+    size_t highWater = 0;   // most bytes any search needed, block plus overflow
+    int depth = 0;          // searches can run inside other searches (e.g. on the calling thread of a fan out)
+    std::vector<std::pair<void*, size_t>> overflow; // heap blocks and their alignment
+    size_t overflowBytes = 0;
+    size_t overflowCount = 0;
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void*, size_t, size_t) override {} // everything goes at once when the scope ends
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+};
+
+/*
+Marks the start of a search on this thread, everything allocated from resource()
+is released when the scope is destroyed. Scopes nest.
+*/
+class ArenaScope {
+public:
+    ArenaScope();
+    ~ArenaScope();
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+    std::pmr::memory_resource* resource() { return &arena; }
+
+private:
+    QueryArena& arena;
+    size_t mark;
+};
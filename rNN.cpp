@@ -2,16 +2,13 @@
 using namespace std;
 
 
-double songDistanceSquare(const song_data& s1, const song_data& s2){
-    return ( 
-            ((s2.duration - s1.duration) * (s2.duration - s1.duration)) + 
-            ((s2.energy - s1.energy) * (s2.energy - s1.energy)) + 
-            ((s2.speechiness - s1.speechiness) * (s2.speechiness - s1.speechiness)) + 
-            ((s2.acousticness - s1.acousticness) * (s2.acousticness - s1.acousticness)) + 
-            ((s2.instrumentalness - s1.instrumentalness) * (s2.instrumentalness- s1.instrumentalness)) + 
-            ((s2.valence - s1.valence) * (s2.valence- s1.valence)) + 
-            ((s2.tempo - s1.tempo) * (s2.tempo - s1.tempo))
-            );
+double songDistanceSquare(const double* s1, const double* s2){
+    double sum = 0;
+    for (int c = 0; c < NUM_FEATURES; c++){
+        double diff = s2[c] - s1[c];
+        sum += diff * diff;
+    }
+    return sum;
 }
 
 double getPercentSim(double distance){
@@ -28,57 +25,33 @@ double getPercentSim(double distance){
     double normalizedD = distance/MAX_DIST;
     return (1-normalizedD); // as a percentage
 }
-vector<SongResult> rNN(const std::vector<song_data>& allSongs, const song_data& search, double r){
+void rNN(const Shard& shard, const double* search, int searchTrack, const std::string& searchArtist, double r, TopK& best){
     const double rSquare = r*r;
-    vector<SongResult> results;
-    unordered_map<double,pair<string,string>> dupes;
-    unordered_set<string> dupeNames;
-    for ( auto& song : allSongs){
-
+    for (int i = 0; i < shard.songs.size(); i++){
         // skip same track as search
-        if (song.track == search.track && song.artist == search.artist){
+        if (shard.trackIds[i] == searchTrack && shard.songs[i].artist == searchArtist){
             continue;
         }
-                
-        double diffDisSquare = songDistanceSquare(song,search);
-        if (diffDisSquare < rSquare){
-            auto check = dupes.find(diffDisSquare);
-            auto nameCheck = dupeNames.find(song.track);
-            if (check != dupes.end() && check->second == make_pair(song.track,song.artist) || nameCheck != dupeNames.end()){ // skip duplicate results
-                continue;
-            }
-            else {
-                results.emplace_back(song.track,song.artist,getPercentSim(sqrt(diffDisSquare)));
-                dupes[diffDisSquare] = make_pair(song.track,song.artist);
-                dupeNames.insert(song.track);
-            }
-        }
-    }
-    
-    // could be removed if we don't want the results in sorted order by similarity
-    std::sort(results.begin(),results.end(),[](const SongResult& s1, const SongResult& s2){return s1.similarity > s2.similarity;});
-    vector<SongResult> toRe;
-    if (results.size() < 10){
-        cout << "Less than 10 matches found";
-    }
-    else {
-        for (int i = 0; i < 10; i++){
-            cout << results[i].similarity;
-            toRe.push_back(results[i]);
+
+        double diffDisSquare = songDistanceSquare(shard.features.row(i),search);
+        // duplicates of the same track are handled by best, it keeps the closest one
+        if (diffDisSquare < rSquare && diffDisSquare < best.bound()){
+            best.offer({shard.globalIndex(i), shard.trackIds[i], diffDisSquare});
         }
     }
-    return toRe;
 }
 
 /* DEBUG ONLY
 int main(int argc, char* argv[]){
-    auto vec = loadData(argv[0]);
-    vec[10001].Print();
-    auto results = rNN(vec,vec[101],0.105);
+    Catalog catalog;
+    catalog.load(argv[0]);
+    catalog.song(10001).Print();
+    vector<SongResult> results;
+    catalog.radius(101,0.105,results);
     cout << "Size of Results: " << results.size() << endl;
-    for (int i = 0; i < 10; i++){
-       cout << "Song: " << results[i].trackName 
-            << " Artist: " << results[i].artist
+    for (int i = 0; i < results.size(); i++){
+       cout << "Song: " << catalog.song(results[i].index).track 
+            << " Artist: " << catalog.song(results[i].index).artist
             << " Similarity: " << results[i].similarity << endl;
     }
     return 0;
@@ -1,20 +1,22 @@
 // this is for the radius nearest neighbors algorithm
 #include <cmath> // for sqrt
 #include <unordered_set>
-#include "data_parse.h"
+#include "catalog.h"
 
 // does this here so it is not recalculted for every iteration
 const double MAX_DIST = sqrt(7);
 
 /* 
-the actual implementation of the radius nearest neighbors algorithm
-compares the squared distances between songs initially for efficiency
-if the squared distance is within r^2 than it performs the sqrt to find the actual distance
+the actual implementation of the radius nearest neighbors algorithm on one shard
+compares the squared distances between songs so no sqrt is needed until the results are shown
+every song within r of search (other than the search song itself, same track and artist) is offered to best,
+which should be made with maxDistSquare = r*r and keeps the closest version of each track
 */
-std::vector<SongResult> rNN(const std::vector<song_data>& allSongs, const song_data& search, double r);
+void rNN(const Shard& shard, const double* search, int searchTrack, const std::string& searchArtist, double r, TopK& best);
 
-// helper to calculate the similarity percentages
+// helper to calculate the similarity percentages, only meaningful with MinMax scaling
+// (every column 0 to 1) which is why radius searches refuse the other modes
 double getPercentSim(double distance);
 
-// helper to calculate the distances between songs
-double songDistanceSquare(const song_data& s1, const song_data& s2);
\ No newline at end of file
+// helper to calculate the distances between songs, takes two rows of the feature matrix
+double songDistanceSquare(const double* s1, const double* s2);
\ No newline at end of file
@@ -0,0 +1,84 @@
+#include "store_cli.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include "block_store.h"
+using namespace std;
+
+static int buildStore(const string& exePath, const filesystem::path& storePath){
+    vector<filesystem::path> paths = datasetFiles(exePath);
+    cout << "Writing " << storePath.string() << " from " << paths.size() << " file(s)..." << endl;
+    writeBlockStore(paths, storePath, ScalingMode::MinMax, SongOrder::Hilbert);
+    BlockStore store(storePath);
+    cout << "Stored " << store.size() << " songs in " << store.blockCount() << " blocks" << endl;
+    return 0;
+}
+
+static int searchStore(const filesystem::path& storePath, const vector<string>& args){
+    bool radius = false;
+    vector<string> names;
+    for (const string& arg : args){
+        if (arg == "--radius"){
+            radius = true;
+        } else {
+            names.push_back(arg);
+        }
+    }
+    if (names.empty() || names.size() > 2){
+        cerr << "usage: melody_map --store <track> [artist] [--radius]" << endl;
+        return 2;
+    }
+    string artist = (names.size() == 2) ? names[1] : "";
+
+    BlockStore store(storePath);
+    int row = store.find(names[0], artist);
+    if (row < 0){
+        cout << "Song not found in database." << endl;
+        return 1;
+    }
+    string track;
+    string foundArtist;
+    store.name(row, track, foundArtist);
+    cout << "Found song: " << track << " by " << foundArtist << endl;
+
+    vector<SongResult> results;
+    if (radius){
+        store.radius(row, 0.220, results); // same radius as the ui
+        if (results.empty()){
+            cout << "Less than 10 matches found" << endl;
+        }
+    } else {
+        store.kNearest(10, row, results);
+    }
+    for (size_t i = 0; i < results.size(); i++){
+        store.name(results[i].index, track, foundArtist);
+        cout << i + 1 << ". " << track << " - " << foundArtist << " ("
+             << static_cast<int>(results[i].similarity * 100) << "% match)" << endl;
+    }
+    cout << "(" << store.blocksScanned() << " of " << store.blockCount() << " blocks read)" << endl;
+    return 0;
+}
+
+int runStoreCommand(int argc, char* argv[]){
+    if (argc < 2){
+        return -1;
+    }
+    string command = argv[1];
+    if (command != "--build-store" && command != "--store"){
+        return -1;
+    }
+    filesystem::path directory = filesystem::path(argv[0]).parent_path();
+    if (directory.empty()){
+        directory = ".";
+    }
+    filesystem::path storePath = directory / "catalog.blocks";
+    try {
+        if (command == "--build-store"){
+            return buildStore(argv[0], storePath);
+        }
+        return searchStore(storePath, vector<string>(argv + 2, argv + argc));
+    } catch (const exception& e) {
+        cerr << "ERROR: " << e.what() << endl;
+        return 1;
+    }
+}
@@ -0,0 +1,11 @@
+// command line searches against a block store, for catalogs too big to load into the app
+#pragma once
+
+/*
+Runs a block store command if argv holds one, the store is catalog.blocks next to the executable.
+  melody_map --build-store                        writes it from dataset.csv and dataset_*.csv
+  melody_map --store <track> [artist] [--radius]  prints the 10 songs most like a track, read from the store
+Only the blocks a search needs are read from disk, so the catalog never has to fit in memory.
+Returns the exit code, or -1 if argv isn't a store command and the app should start as usual
+*/
+int runStoreCommand(int argc, char* argv[]);
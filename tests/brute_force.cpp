@@ -0,0 +1,98 @@
+#include "brute_force.h"
+#include "rNN.h"
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
+using namespace std;
+
+vector<Neighbor> bruteTopK(const Catalog& catalog, int k, double maxDistSquare,
+                           const function<double(int)>& distSquare, const function<bool(int)>& skip){
+    vector<pair<double,int>> all;
+    all.reserve(catalog.size());
+    for (int i = 0; i < catalog.size(); i++){
+        if (skip(i)){
+            continue;
+        }
+        double d = distSquare(i);
+        if (d < maxDistSquare){
+            all.emplace_back(d, i);
+        }
+    }
+
+    // sorting everything is too slow for the 10M runs, so sort the closest few and widen until k tracks are in
+    for (size_t m = 8 * k; ; m *= 2){
+        size_t count = min(m, all.size());
+        nth_element(all.begin(), all.begin() + count - (count > 0), all.end());
+        sort(all.begin(), all.begin() + count);
+
+        vector<Neighbor> best;
+        unordered_set<int> tracks;
+        for (size_t i = 0; i < count && best.size() < k; i++){
+            int track = catalog.trackId(all[i].second);
+            if (tracks.insert(track).second){
+                best.push_back({all[i].second, track, all[i].first});
+            }
+        }
+        if (best.size() == k || count == all.size()){
+            return best;
+        }
+    }
+}
+
+vector<Neighbor> bruteNearest(const Catalog& catalog, int k, int index){
+    const double* search = catalog.featureRow(index);
+    return bruteNearestTo(catalog, k, search, catalog.trackId(index));
+}
+
+vector<Neighbor> bruteNearestTo(const Catalog& catalog, int k, const double* target, int skipTrack){
+    return bruteTopK(catalog, k, numeric_limits<double>::infinity(),
+                     [&](int i){ return songDistanceSquare(target, catalog.featureRow(i)); },
+                     [&](int i){ return catalog.trackId(i) == skipTrack; });
+}
+
+vector<Neighbor> bruteRadius(const Catalog& catalog, int index, double r){
+    const double* search = catalog.featureRow(index);
+    const song_data& song = catalog.song(index);
+    vector<Neighbor> best = bruteTopK(catalog, 10, r * r,
+                                      [&](int i){ return songDistanceSquare(search, catalog.featureRow(i)); },
+                                      [&](int i){ return catalog.song(i).track == song.track &&
+                                                         catalog.song(i).artist == song.artist; });
+    if (best.size() < 10){
+        best.clear();
+    }
+    return best;
+}
+
+double multiScore(const Catalog& catalog, int index, const vector<int>& seeds,
+                  const vector<double>& weights, SeedAggregate aggregate){
+    const double* song = catalog.featureRow(index);
+    if (aggregate == SeedAggregate::Min){
+        double closest = numeric_limits<double>::infinity();
+        for (int seed : seeds){
+            closest = min(closest, sqrt(songDistanceSquare(song, catalog.featureRow(seed))));
+        }
+        return closest;
+    }
+    double sum = 0;
+    double total = 0;
+    for (size_t j = 0; j < seeds.size(); j++){
+        double w = (aggregate == SeedAggregate::Weighted) ? weights[j] : 1.0;
+        sum += w * sqrt(songDistanceSquare(song, catalog.featureRow(seeds[j])));
+        total += w;
+    }
+    return sum / total;
+}
+
+vector<Neighbor> bruteMulti(const Catalog& catalog, int k, const vector<int>& seeds,
+                            const vector<double>& weights, SeedAggregate aggregate){
+    unordered_set<int> seedTracks;
+    for (int seed : seeds){
+        seedTracks.insert(catalog.trackId(seed));
+    }
+    return bruteTopK(catalog, k, numeric_limits<double>::infinity(),
+                     [&](int i){
+                         double score = multiScore(catalog, i, seeds, weights, aggregate);
+                         return score * score;
+                     },
+                     [&](int i){ return seedTracks.count(catalog.trackId(i)) > 0; });
+}
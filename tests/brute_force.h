@@ -0,0 +1,31 @@
+// slow but obviously correct versions of every search, the real engines are checked against these
+#pragma once
+#include <functional>
+#include <vector>
+#include "catalog.h"
+#include "multi_seed.h"
+
+/*
+Scores every song and keeps the k best under maxDistSquare, closest version of each track only,
+as Neighbors holding the global index and the exact squared distance (or squared aggregate score).
+skip says which songs can't be in the result at all
+*/
+std::vector<Neighbor> bruteTopK(const Catalog& catalog, int k, double maxDistSquare,
+                                const std::function<double(int)>& distSquare, const std::function<bool(int)>& skip);
+
+// Catalog::kNearest, every other version of the track is skipped
+std::vector<Neighbor> bruteNearest(const Catalog& catalog, int k, int index);
+
+// Catalog::kNearestTo, skipTrack is a track id to leave out or -1
+std::vector<Neighbor> bruteNearestTo(const Catalog& catalog, int k, const double* target, int skipTrack = -1);
+
+// Catalog::radius, only the song itself (same track and artist) is skipped, empty if fewer than 10 are in range
+std::vector<Neighbor> bruteRadius(const Catalog& catalog, int index, double r);
+
+// Catalog::kNearestMulti
+std::vector<Neighbor> bruteMulti(const Catalog& catalog, int k, const std::vector<int>& seeds,
+                                 const std::vector<double>& weights, SeedAggregate aggregate);
+
+// the aggregate score of one song against the seeds, straight from the definition in multi_seed.h
+double multiScore(const Catalog& catalog, int index, const std::vector<int>& seeds,
+                  const std::vector<double>& weights, SeedAggregate aggregate);
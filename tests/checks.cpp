@@ -0,0 +1,358 @@
+/*
+Correctness checks for the parts of the app that aren't search engines.
+Returns non zero if the check fails.
+
+  melody_map_checks autocomplete   exact prefixes of popular titles win over a crowd of one typo matches
+  melody_map_checks typos        misspelled titles are found and beat more popular titles with more typos
+  melody_map_checks csv_scan       the vectorized tokenizer splits exactly like getline + parseRow
+  melody_map_checks scaling        every scaling mode's offset and scale match a direct computation
+  melody_map_checks store_find     the block store finds every song by track and artist like the search box
+*/
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "autocomplete.h"
+#include "block_store.h"
+#include "catalog.h"
+#include "csv_scan.h"
+#include "data_parse.h"
+using namespace std;
+
+static int failures = 0;
+
+static void expect(bool ok, const string& what){
+    if (!ok){
+        cout << "FAIL " << what << endl;
+        failures++;
+    }
+}
+
+// one dataset.csv row with only the columns that matter here filled in
+static string songRow(int i, const string& track, const string& artist, int popularity){
+    char numbers[128];
+    snprintf(numbers, sizeof(numbers), "%d,200000,False,0.5,0.5,5,-6.0,1,0.1,0.3,0.0,0.2,0.5,120.0,4,pop",
+             popularity);
+    return to_string(i) + ",id" + to_string(i) + "," + artist + ",album," + track + "," + numbers + "\n";
+}
+
+// a popular title hidden among thousands of less popular words one typo away from what is typed.
+// the typo matches are more than enough to fill the candidate cap, the exact prefix still has to win
+static void checkAutocomplete(){
+    filesystem::path dir = filesystem::temp_directory_path() / "melody_map_checks_autocomplete";
+    filesystem::create_directories(dir);
+    {
+        ofstream file(dir / "dataset.csv", ios::binary | ios::trunc);
+        file << ",track_id,artists,album_name,track_name,popularity,duration_ms,explicit,danceability,energy,key,"
+                "loudness,mode,speechiness,acousticness,instrumentalness,liveness,valence,tempo,time_signature,track_genre\n";
+        file << songRow(0, "Lovely Day", "Bill Withers", 100);
+        mt19937 rng(7);
+        unordered_set<string> fillers;
+        int row = 1;
+        while (fillers.size() < 30000){
+            // "lo" then anything but v, so every one of them is a single typo away from "lov" and "love"
+            string word = "lo";
+            char third = 'a' + rng() % 25;
+            word += (third >= 'v') ? third + 1 : third;
+            for (int c = 0; c < 4; c++){
+                word += static_cast<char>('a' + rng() % 26);
+            }
+            if (fillers.insert(word).second){
+                file << songRow(row++, word, "Band " + to_string(row), 90);
+            }
+        }
+    }
+
+    Catalog catalog;
+    catalog.load((dir / "exe").string());
+    FuzzyIndex index;
+    index.build(catalog);
+
+    for (const string& typed : {"lov", "love", "lovel", "Lovely D"}){
+        vector<int> results = index.search(typed, 10);
+        expect(!results.empty() && catalog.song(results[0]).track == "Lovely Day",
+               "autocomplete: \"" + typed + "\" should rank Lovely Day first");
+    }
+    filesystem::remove_all(dir);
+}
+
+// the query, the title it means, and a more popular title that is further away from what was typed
+struct TypoCase {
+    const char* typed;
+    const char* track;
+    const char* decoy;
+};
+
+// a swap, a missing letter and a second typo on popular decoys, the closest title has to come first
+static void checkTypos(){
+    filesystem::path dir = filesystem::temp_directory_path() / "melody_map_checks_typos";
+    filesystem::create_directories(dir);
+    {
+        ofstream file(dir / "dataset.csv", ios::binary | ios::trunc);
+        file << ",track_id,artists,album_name,track_name,popularity,duration_ms,explicit,danceability,energy,key,"
+                "loudness,mode,speechiness,acousticness,instrumentalness,liveness,valence,tempo,time_signature,track_genre\n";
+        file << songRow(0, "Bohemian Rhapsody", "Queen", 40);
+        file << songRow(1, "Bohemia", "Night Tram", 100);
+        file << songRow(2, "Rhapsodie", "Orchestre Lune", 100);
+        file << songRow(3, "Bohemia", "Queens", 95);
+        file << songRow(4, "Killer Queen", "Queen", 100);
+        file << songRow(5, "Hotel California", "Eagles", 100);
+    }
+
+    Catalog catalog;
+    catalog.load((dir / "exe").string());
+    FuzzyIndex index;
+    index.build(catalog);
+
+    const TypoCase cases[] = {
+        {"bohemain", "Bohemian Rhapsody", "Bohemia"},        // swapped letters, the decoy is two edits away
+        {"rhapsdoy", "Bohemian Rhapsody", "Rhapsodie"},      // swapped letters in the second word
+        {"bohmian", "Bohemian Rhapsody", "Bohemia"},         // missing letter
+        {"queen bohmian", "Bohemian Rhapsody", "Bohemia"},   // artist plus a missing letter, the decoy is by Queens
+    };
+    for (const TypoCase& c : cases){
+        vector<int> results = index.search(c.typed, 10);
+        string what = string("typos: \"") + c.typed + "\"";
+        expect(!results.empty() && catalog.song(results[0]).track == c.track,
+               what + " should rank " + c.track + " first");
+        bool decoyFound = false;
+        for (int r : results){
+            decoyFound = decoyFound || catalog.song(r).track == c.decoy;
+        }
+        expect(decoyFound, what + " should still find " + c.decoy + " further down");
+    }
+    filesystem::remove_all(dir);
+}
+
+// rows of text the slow way, the reference scanCsv has to agree with
+static vector<vector<string>> referenceRows(const string& text){
+    vector<vector<string>> rows;
+    istringstream lines(text);
+    string line;
+    while (getline(lines, line)){
+        rows.push_back(parseRow(line));
+    }
+    return rows;
+}
+
+static vector<vector<string>> scannedRows(const string& text){
+    vector<vector<string>> rows;
+    vector<string> fields;
+    scanCsv(text.data(), text.size(), fields, [&](const vector<string>& row){
+        rows.push_back(row);
+    });
+    return rows;
+}
+
+static string printable(const string& text){
+    string out;
+    for (char c : text){
+        if (c == '\n') out += "\\n";
+        else if (c == '\r') out += "\\r";
+        else out += c;
+    }
+    return out;
+}
+
+static void expectSameRows(const string& text, const string& what){
+    if (scannedRows(text) != referenceRows(text)){
+        expect(false, "csv_scan: " + what + " splits differently from parseRow: \"" + printable(text) + "\"");
+    }
+}
+
+// every special character (quotes, commas and newlines inside quotes, ;, crlf) at every spot around
+// the 64 byte block boundaries, then a lot of random text made mostly of special characters
+static void checkCsvScan(){
+    const vector<string> awkward = {
+        "\"a,b\"", "\"line\nbreak\"", "x;y", "\"q;\"", "\"\"", "\"", ",", "\r\n", "\n", "\r", "\"a\"\"b\"",
+    };
+    for (const string& piece : awkward){
+        for (size_t at = 0; at < 140; at++){
+            string text(at, 'a');
+            for (size_t i = 7; i < at; i += 9){
+                text[i] = ','; // some ordinary fields before it
+            }
+            text += piece + ",tail\r\nnext,row\n";
+            expectSameRows(text, "\"" + printable(piece) + "\" at byte " + to_string(at));
+            text.pop_back(); // and without the last newline
+            expectSameRows(text, "\"" + printable(piece) + "\" at byte " + to_string(at) + " without a last newline");
+        }
+    }
+
+    mt19937 rng(31);
+    const char alphabet[] = {'a', 'b', '1', ' ', ',', ',', '"', '"', ';', '\n', '\r'};
+    for (int i = 0; i < 50000 && failures < 10; i++){
+        string text(rng() % 300, ' ');
+        for (char& c : text){
+            c = alphabet[rng() % sizeof(alphabet)];
+        }
+        expectSameRows(text, "random input " + to_string(i));
+    }
+    expectSameRows("", "empty input");
+}
+
+// offset and scale of one column worked out directly from all of its values
+static void directScaling(vector<double> column, int c, ScalingMode mode, double& offset, double& scale){
+    sort(column.begin(), column.end());
+    size_t n = column.size();
+    offset = 0;
+    scale = 1;
+    if (mode == ScalingMode::MinMax){
+        if (c == DURATION || c == TEMPO){
+            offset = column.front();
+            scale = column.back() - column.front();
+        }
+    }
+    else if (mode == ScalingMode::ZScore){
+        double sum = 0;
+        for (double x : column) sum += x;
+        offset = sum / n;
+        double squares = 0;
+        for (double x : column) squares += (x - offset) * (x - offset);
+        scale = (n < 2) ? 0 : sqrt(squares / (n - 1));
+    }
+    else {
+        offset = column[(n - 1) / 2];
+        scale = column[static_cast<size_t>(0.75 * (n - 1))] - column[static_cast<size_t>(0.25 * (n - 1))];
+    }
+    if (scale == 0){
+        scale = 1;
+    }
+}
+
+// shareScaling over a few parts of different sizes (some of them tiny) against directScaling,
+// then applyScaling against (raw - offset) / scale
+static void checkScaling(){
+    mt19937 rng(26);
+    for (ScalingMode mode : {ScalingMode::MinMax, ScalingMode::ZScore, ScalingMode::Robust}){
+        for (size_t songs : {1, 2, 3, 4, 7, 100, 5001}){
+            vector<FeatureMatrix> parts(3);
+            vector<double> columns[NUM_FEATURES];
+            for (size_t i = 0; i < songs; i++){
+                FeatureMatrix& part = parts[rng() % parts.size()];
+                for (int c = 0; c < NUM_FEATURES; c++){
+                    // a few repeats so the percentiles have ties to get through
+                    double x = (c == DURATION) ? 30000.0 + rng() % 400000 : (rng() % 200) / 199.0;
+                    part.values.push_back(x);
+                    part.stats[c].add(x);
+                    columns[c].push_back(x);
+                }
+            }
+            vector<FeatureMatrix> raw = parts;
+            vector<FeatureMatrix*> pointers;
+            for (auto& part : parts){
+                pointers.push_back(&part);
+            }
+            shareScaling(pointers, mode);
+
+            string what = "scaling: mode " + to_string(static_cast<int>(mode)) + ", " + to_string(songs) + " songs";
+            for (int c = 0; c < NUM_FEATURES; c++){
+                double offset, scale;
+                directScaling(columns[c], c, mode, offset, scale);
+                for (const auto& part : parts){
+                    expect(fabs(part.offset[c] - offset) <= 1e-9 * max(1.0, fabs(offset)) &&
+                           fabs(part.scale[c] - scale) <= 1e-9 * max(1.0, fabs(scale)),
+                           what + ", column " + to_string(c) + " offset/scale");
+                }
+            }
+            for (size_t p = 0; p < parts.size(); p++){
+                parts[p].applyScaling();
+                for (size_t i = 0; i < parts[p].values.size(); i++){
+                    int c = i % NUM_FEATURES;
+                    double expected = (raw[p].values[i] - parts[p].offset[c]) / parts[p].scale[c];
+                    expect(fabs(parts[p].values[i] - expected) <= 1e-9 * max(1.0, fabs(expected)),
+                           what + ", scaled value");
+                }
+            }
+        }
+    }
+    // the radius and its percentages only mean something in MinMax space, the other modes are refused
+    filesystem::path dir = filesystem::temp_directory_path() / "melody_map_checks_scaling";
+    filesystem::create_directories(dir);
+    {
+        ofstream file(dir / "dataset.csv", ios::binary | ios::trunc);
+        file << ",track_id,artists,album_name,track_name,popularity,duration_ms,explicit,danceability,energy,key,"
+                "loudness,mode,speechiness,acousticness,instrumentalness,liveness,valence,tempo,time_signature,track_genre\n";
+        for (int i = 0; i < 20; i++){
+            file << songRow(i, "Song " + to_string(i), "Band", i);
+        }
+    }
+    for (ScalingMode mode : {ScalingMode::MinMax, ScalingMode::ZScore, ScalingMode::Robust}){
+        Catalog catalog;
+        catalog.load((dir / "exe").string(), mode);
+        vector<SongResult> results;
+        bool refused = false;
+        try {
+            catalog.radius(0, 0.220, results);
+        } catch (const logic_error&) {
+            refused = true;
+        }
+        expect(refused == (mode != ScalingMode::MinMax),
+               "scaling: radius with mode " + to_string(static_cast<int>(mode)) + " should " +
+               (mode == ScalingMode::MinMax ? "run" : "throw"));
+    }
+    filesystem::remove_all(dir);
+}
+
+// versions of the same track by different artists, spread over a few blocks
+static void checkStoreFind(){
+    filesystem::path dir = filesystem::temp_directory_path() / "melody_map_checks_store_find";
+    filesystem::create_directories(dir);
+    const int songs = 3000;
+    {
+        ofstream file(dir / "dataset.csv", ios::binary | ios::trunc);
+        file << ",track_id,artists,album_name,track_name,popularity,duration_ms,explicit,danceability,energy,key,"
+                "loudness,mode,speechiness,acousticness,instrumentalness,liveness,valence,tempo,time_signature,track_genre\n";
+        for (int i = 0; i < songs; i++){
+            // every 7th track name is shared by the next row, with another artist
+            int track = i - (i % 7 == 1 ? 1 : 0);
+            file << songRow(i, "Track " + to_string(track), "Band " + to_string(i), 50);
+        }
+    }
+    writeBlockStore({dir / "dataset.csv"}, dir / "catalog.blocks");
+    {
+        BlockStore store(dir / "catalog.blocks");
+        for (int i = 0; i < songs; i++){
+            int track = i - (i % 7 == 1 ? 1 : 0);
+            expect(store.find("Track " + to_string(track), "Band " + to_string(i)) == i,
+                   "store_find: row " + to_string(i) + " by track and artist");
+        }
+        // the first version when the artist is missing or wrong
+        expect(store.find("Track 7", "") == 7, "store_find: no artist gives the first version");
+        expect(store.find("Track 7", "Nobody") == 7, "store_find: an unknown artist gives the first version");
+        expect(store.find("Track 7", "Band 8") == 8, "store_find: the second version by its artist");
+        expect(store.find("Track 8", "Band 8") == -1, "store_find: a track that isn't there");
+        expect(store.find("", "") == -1, "store_find: an empty name");
+    }
+    filesystem::remove_all(dir);
+}
+
+int main(int argc, char* argv[]){
+    if (argc != 2){
+        cerr << "usage: melody_map_checks autocomplete|typos|csv_scan|scaling|store_find" << endl;
+        return 2;
+    }
+    string check = argv[1];
+    if (check == "autocomplete") checkAutocomplete();
+    else if (check == "typos") checkTypos();
+    else if (check == "csv_scan") checkCsvScan();
+    else if (check == "scaling") checkScaling();
+    else if (check == "store_find") checkStoreFind();
+    else {
+        cerr << "unknown check " << check << endl;
+        return 2;
+    }
+    if (failures){
+        cout << failures << " failure(s)" << endl;
+        return 1;
+    }
+    cout << check << " ok" << endl;
+    return 0;
+}
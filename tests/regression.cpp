@@ -0,0 +1,492 @@
+/*
+Recall and latency regression suite.
+Every search engine is run on thousands of random seeds against a synthetic catalog and compared
+with the brute force reference (brute_force.h):
+ recall@k    - share of the reference songs the engine found (songs tied with the kth one count too)
+ exact       - share of queries where the engine gave the reference list (same distances in the same order)
+ score delta - biggest difference between a reported similarity and the one for the reference song
+Latency is timed per query and its p50 is compared with a plain single threaded scan of the catalog,
+so the limits mean the same thing on fast and slow machines.
+Returns non zero if any engine falls below its limits.
+
+  melody_map_tests --songs 20000 --queries 1000     recall and latency on one catalog
+  melody_map_tests --scale 100000,1000000,10000000  the same at each size (needs disk and memory)
+  melody_map_tests --allocations                    searches must not allocate once warmed up
+*/
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include "brute_force.h"
+#include "synthetic_catalog.h"
+#include "block_store.h"
+#include "catalog.h"
+#include "kNN.h"
+#include "multi_seed.h"
+#include "rNN.h"
+using namespace std;
+
+// every allocation in the process goes through here so --allocations can count them
+static atomic<bool> countAllocations{false};
+static atomic<long> allocationCount{0};
+
+void* operator new(size_t bytes){
+    if (countAllocations){
+        allocationCount++;
+    }
+    void* memory = malloc(bytes ? bytes : 1);
+    if (!memory){
+        throw bad_alloc();
+    }
+    return memory;
+}
+
+// the arena borrows aligned memory from the heap when it runs out, those count too
+void* operator new(size_t bytes, align_val_t alignment){
+    if (countAllocations){
+        allocationCount++;
+    }
+    size_t align = static_cast<size_t>(alignment);
+    void* memory = aligned_alloc(align, (bytes + align - 1) / align * align);
+    if (!memory){
+        throw bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void* memory) noexcept { free(memory); }
+void operator delete(void* memory, size_t) noexcept { free(memory); }
+void operator delete(void* memory, align_val_t) noexcept { free(memory); }
+void operator delete(void* memory, size_t, align_val_t) noexcept { free(memory); }
+
+/*
+The limits every engine has to stay within.
+latency is the most its p50 may be compared to the baseline the engine replaces
+(a single threaded scan, or for multi seed one scan per seed, or for the slider search a full kNearestTo).
+They are set a bit above what a release build measured on one core with the ctest run (20000 songs),
+so a change that loses an engine's pruning fails instead of hiding under the limit.
+More cores or bigger catalogs only lower the ratios
+*/
+struct Limits {
+    const char* engine;
+    double minRecall;
+    double minExact;
+    double maxScoreDelta;
+    double maxLatency;
+};
+
+static const Limits LIMITS[] = {
+    // the fan out over the shards only pays off with more than one core
+    {"knn",           0.999, 0.99, 1e-6, 1.3},   // measured 1.04 - 1.09
+    {"radius",        0.999, 0.99, 1e-6, 1.0},   // 0.71 - 0.75
+    {"slider-knn",    0.999, 0.99, 1e-6, 0.1},   // 0.02 - 0.03
+    {"multi-min",     0.999, 0.99, 1e-6, 0.65},  // 0.29 - 0.44
+    {"multi-mean",    0.999, 0.99, 1e-6, 0.5},   // 0.28 - 0.36
+    {"multi-weighted",0.999, 0.99, 1e-6, 0.45},  // 0.25 - 0.31
+    {"store-knn",     0.999, 0.99, 1e-6, 0.8},   // 0.49 - 0.59
+    {"store-radius",  0.999, 0.99, 1e-6, 0.7},   // 0.41 - 0.49
+};
+
+const double SEARCH_RADIUS = 0.220; // same as the ui
+const int SEEDS_PER_QUERY = 20;
+
+struct Options {
+    size_t songs = 20000;
+    int queries = 1000;
+    uint32_t seed = 42;
+    vector<size_t> scale;
+    bool allocations = false;
+    double latencySlack = 1.0; // multiplies every latency limit, for noisy machines
+};
+
+double percentile(vector<double> values, double p){
+    if (values.empty()){
+        return 0;
+    }
+    size_t n = min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    nth_element(values.begin(), values.begin() + n, values.end());
+    return values[n];
+}
+
+// everything measured for one engine
+struct Report {
+    string engine;
+    size_t queries = 0;
+    size_t exact = 0;
+    double recall = 0;
+    double scoreDelta = 0;
+    vector<double> micros;
+    vector<double> baseMicros; // what the engine is compared against, timed next to it so both see the same noise
+    double baseScale = 1;      // how many of those one query stands for
+
+    explicit Report(const string& engine) : engine(engine) {}
+
+    /*
+    distSquare gives the exact squared distance (or score) of any song for this query,
+    similarity turns a distance into what the engine reports
+    */
+    void add(const vector<SongResult>& results, const vector<Neighbor>& reference,
+             const function<double(int)>& distSquare, double (*similarity)(double)){
+        queries++;
+        const double eps = 1e-9;
+
+        unordered_set<int> wanted;
+        for (const auto& n : reference){
+            wanted.insert(n.index);
+        }
+        double kth = reference.empty() ? 0 : reference.back().distSquare;
+        size_t hits = 0;
+        for (const auto& r : results){
+            if (wanted.count(r.index) || distSquare(r.index) <= kth + eps){
+                hits++;
+            }
+        }
+        recall += reference.empty() ? (results.empty() ? 1.0 : 0.0)
+                                    : min(1.0, static_cast<double>(hits) / reference.size());
+
+        bool same = results.size() == reference.size();
+        for (size_t j = 0; j < min(results.size(), reference.size()); j++){
+            if (fabs(distSquare(results[j].index) - reference[j].distSquare) > eps){
+                same = false;
+            }
+            scoreDelta = max(scoreDelta, fabs(results[j].similarity - similarity(sqrt(reference[j].distSquare))));
+        }
+        if (same){
+            exact++;
+        }
+    }
+};
+
+template <class F>
+double timeMicros(F&& f){
+    auto start = chrono::steady_clock::now();
+    f();
+    return chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+}
+
+// a few synthetic shard files in dir, like dataset.csv and dataset_*.csv next to the app
+vector<filesystem::path> makeCatalogFiles(const filesystem::path& dir, size_t songs, uint32_t seed){
+    filesystem::create_directories(dir);
+    vector<filesystem::path> paths = {dir / "dataset.csv", dir / "dataset_b.csv", dir / "dataset_c.csv"};
+    for (size_t i = 0; i < paths.size(); i++){
+        size_t count = songs / paths.size() + (i < songs % paths.size());
+        writeSyntheticCatalog(paths[i], count, seed + i);
+    }
+    return paths;
+}
+
+// seed songs that look like a playlist, a few songs and their neighbours
+vector<int> playlistSeeds(Catalog& catalog, mt19937& rng){
+    vector<int> seeds;
+    vector<SongResult> around;
+    while (seeds.size() < SEEDS_PER_QUERY){
+        int anchor = rng() % catalog.size();
+        seeds.push_back(anchor);
+        catalog.kNearest(SEEDS_PER_QUERY / 4 - 1, anchor, around);
+        for (const auto& r : around){
+            if (seeds.size() < SEEDS_PER_QUERY){
+                seeds.push_back(r.index);
+            }
+        }
+    }
+    return seeds;
+}
+
+vector<Report> runEngines(Catalog& catalog, BlockStore& store, const Options& options){
+    mt19937 rng(options.seed);
+    vector<Report> reports;
+    vector<SongResult> results;
+    vector<int> queries(options.queries);
+    for (int& q : queries){
+        q = rng() % catalog.size();
+    }
+
+    // what the engines replace, one thread going over every song
+    auto scan = [&](int q){
+        return timeMicros([&]{
+            TopK best(10);
+            for (const auto& shard : catalog.shards){
+                kNearestNeighbors(shard, catalog.featureRow(q), catalog.trackId(q), best);
+            }
+        });
+    };
+
+    Report knn{"knn"};
+    for (int q : queries){
+        knn.baseMicros.push_back(scan(q));
+        knn.micros.push_back(timeMicros([&]{ catalog.kNearest(10, q, results); }));
+        const double* search = catalog.featureRow(q);
+        knn.add(results, bruteNearest(catalog, 10, q),
+                [&](int i){ return songDistanceSquare(search, catalog.featureRow(i)); }, getInverseSim);
+    }
+    reports.push_back(knn);
+
+    Report radius{"radius"};
+    for (int q : queries){
+        radius.baseMicros.push_back(scan(q));
+        radius.micros.push_back(timeMicros([&]{ catalog.radius(q, SEARCH_RADIUS, results); }));
+        const double* search = catalog.featureRow(q);
+        radius.add(results, bruteRadius(catalog, q, SEARCH_RADIUS),
+                   [&](int i){ return songDistanceSquare(search, catalog.featureRow(i)); }, getPercentSim);
+    }
+    reports.push_back(radius);
+
+    // slider drags, one feature nudged at a time starting from a random song
+    Report slider{"slider-knn"};
+    IncrementalKNN incremental(10);
+    vector<SongResult> full;
+    double raw[NUM_FEATURES];
+    normal_distribution<double> nudge(0.0, 0.01);
+    for (int step = 0; step < options.queries; step++){
+        if (step % 50 == 0){
+            catalog.song(queries[step]).rawFeatures(raw);
+        }
+        int c = rng() % NUM_FEATURES;
+        const ColumnStats& stats = catalog.columnStats(c);
+        raw[c] = clamp(raw[c] + nudge(rng) * (stats.max - stats.min), stats.min, stats.max);
+        double target[NUM_FEATURES];
+        catalog.scaleFeatures(raw, target);
+
+        slider.micros.push_back(timeMicros([&]{ incremental.search(catalog, target, results); }));
+        slider.baseMicros.push_back(timeMicros([&]{ catalog.kNearestTo(10, target, full); }));
+        slider.add(results, bruteNearestTo(catalog, 10, target),
+                   [&](int i){ return songDistanceSquare(target, catalog.featureRow(i)); }, getInverseSim);
+    }
+    reports.push_back(slider);
+
+    // playlists, fewer of them since the reference scores every song against every seed
+    const pair<const char*, SeedAggregate> aggregates[] = {
+        {"multi-min", SeedAggregate::Min}, {"multi-mean", SeedAggregate::Mean}, {"multi-weighted", SeedAggregate::Weighted}};
+    for (const auto& [name, aggregate] : aggregates){
+        Report multi{name};
+        multi.baseScale = SEEDS_PER_QUERY;
+        for (int q = 0; q < max(1, options.queries / 20); q++){
+            vector<int> seeds = playlistSeeds(catalog, rng);
+            vector<double> weights;
+            for (size_t j = 0; j < seeds.size(); j++){
+                weights.push_back(1 + rng() % 4);
+            }
+            multi.baseMicros.push_back(scan(seeds.front()));
+            multi.micros.push_back(timeMicros([&]{ catalog.kNearestMulti(10, seeds, weights, aggregate, results); }));
+            multi.add(results, bruteMulti(catalog, 10, seeds, weights, aggregate),
+                      [&](int i){
+                          double score = multiScore(catalog, i, seeds, weights, aggregate);
+                          return score * score;
+                      }, getInverseSim);
+        }
+        reports.push_back(multi);
+    }
+
+    // the block store numbers songs by csv row, the same as the global indices of the catalog
+    Report storeKnn{"store-knn"};
+    Report storeRadius{"store-radius"};
+    for (int q : queries){
+        auto distSquare = [&](int i){ return songDistanceSquare(catalog.featureRow(q), catalog.featureRow(i)); };
+
+        storeKnn.baseMicros.push_back(scan(q));
+        storeRadius.baseMicros.push_back(storeKnn.baseMicros.back());
+        storeKnn.micros.push_back(timeMicros([&]{ store.kNearest(10, q, results); }));
+        storeKnn.add(results, bruteNearest(catalog, 10, q), distSquare, getInverseSim);
+
+        storeRadius.micros.push_back(timeMicros([&]{ store.radius(q, SEARCH_RADIUS, results); }));
+        storeRadius.add(results, bruteRadius(catalog, q, SEARCH_RADIUS), distSquare, getPercentSim);
+    }
+    reports.push_back(storeKnn);
+    reports.push_back(storeRadius);
+    return reports;
+}
+
+// prints the table and returns how many limits were broken
+int checkReports(const vector<Report>& reports, const Options& options){
+    int failures = 0;
+    printf("%-15s %8s %9s %8s %10s %10s %10s %10s %10s %8s\n", "engine", "queries", "recall@k", "exact",
+           "delta", "p50 us", "p90 us", "p99 us", "max us", "vs base");
+    for (const auto& report : reports){
+        double recall = report.recall / max<size_t>(1, report.queries);
+        double exact = static_cast<double>(report.exact) / max<size_t>(1, report.queries);
+        double p50 = percentile(report.micros, 0.5);
+        double baseline = percentile(report.baseMicros, 0.5) * report.baseScale;
+        double ratio = baseline > 0 ? p50 / baseline : 0;
+        printf("%-15s %8zu %9.4f %8.4f %10.2e %10.1f %10.1f %10.1f %10.1f %8.2f\n", report.engine.c_str(),
+               report.queries, recall, exact, report.scoreDelta, p50, percentile(report.micros, 0.9),
+               percentile(report.micros, 0.99), percentile(report.micros, 1.0), ratio);
+
+        for (const auto& limits : LIMITS){
+            if (report.engine != limits.engine){
+                continue;
+            }
+            auto fail = [&](const string& what){
+                cout << "FAIL " << report.engine << ": " << what << endl;
+                failures++;
+            };
+            if (recall < limits.minRecall){
+                fail("recall " + to_string(recall) + " < " + to_string(limits.minRecall));
+            }
+            if (exact < limits.minExact){
+                fail("exact " + to_string(exact) + " < " + to_string(limits.minExact));
+            }
+            if (report.scoreDelta > limits.maxScoreDelta){
+                fail("score delta " + to_string(report.scoreDelta) + " > " + to_string(limits.maxScoreDelta));
+            }
+            if (ratio > limits.maxLatency * options.latencySlack){
+                fail("p50 latency " + to_string(ratio) + "x its baseline > " +
+                     to_string(limits.maxLatency * options.latencySlack) + "x");
+            }
+        }
+    }
+    return failures;
+}
+
+int runSize(size_t songs, const Options& options){
+    filesystem::path dir = filesystem::temp_directory_path() / ("melody_map_tests_" + to_string(songs));
+    cout << "\n== " << songs << " songs ==" << endl;
+
+    double generate = timeMicros([&]{ makeCatalogFiles(dir, songs, options.seed); });
+    Catalog catalog;
+    double load = timeMicros([&]{ catalog.load((dir / "exe").string(), ScalingMode::MinMax, SongOrder::Hilbert); });
+    vector<filesystem::path> paths;
+    for (const auto& shard : catalog.shards){
+        paths.push_back(shard.source);
+    }
+    double write = timeMicros([&]{ writeBlockStore(paths, dir / "catalog.blocks"); });
+    printf("generate %.2fs, load %.2fs, block store %.2fs\n", generate / 1e6, load / 1e6, write / 1e6);
+
+    int failures;
+    {
+        BlockStore store(dir / "catalog.blocks");
+        failures = checkReports(runEngines(catalog, store, options), options);
+    }
+    filesystem::remove_all(dir);
+    return failures;
+}
+
+// the pool hands shards to whichever thread is free, so warm-up searches alone can miss a worker.
+// every thread takes exactly one task here (none leaves until all have arrived) and scans every shard
+static void warmEveryThread(Catalog& catalog, const vector<int>& seeds, const vector<double>& weights){
+    int threads = catalog.pool().threads();
+    atomic<int> arrived{0};
+    auto warm = [&](int){
+        arrived++;
+        while (arrived < threads){
+            this_thread::yield();
+        }
+        for (SeedAggregate aggregate : {SeedAggregate::Min, SeedAggregate::Weighted}){
+            ArenaScope scope;
+            SeedQuery query(scope.resource());
+            query.prepare(catalog, seeds, weights, aggregate);
+            for (const auto& shard : catalog.shards){
+                SeedScratch scratch(query, shard, scope.resource());
+                TopK best(10, numeric_limits<double>::infinity(), scope.resource());
+                multiSeedNearest(shard, query, scratch, best);
+            }
+        }
+    };
+    catalog.pool().run(threads, warm);
+}
+
+// once everything has grown to fit, searches shouldn't touch the heap
+int runAllocations(const Options& options){
+    filesystem::path dir = filesystem::temp_directory_path() / "melody_map_tests_allocations";
+    vector<filesystem::path> paths = makeCatalogFiles(dir, 20000, options.seed);
+    Catalog catalog;
+    catalog.load((dir / "exe").string(), ScalingMode::MinMax, SongOrder::Hilbert);
+    vector<filesystem::path> sources;
+    for (const auto& shard : catalog.shards){
+        sources.push_back(shard.source);
+    }
+    writeBlockStore(sources, dir / "catalog.blocks");
+    BlockStore store(dir / "catalog.blocks");
+    IncrementalKNN incremental(10);
+
+    mt19937 rng(options.seed);
+    vector<int> seeds = playlistSeeds(catalog, rng);
+    vector<double> weights(seeds.size(), 1.0);
+    vector<SongResult> results;
+    results.reserve(10);
+    auto searches = [&](int q){
+        catalog.kNearest(10, q, results);
+        catalog.radius(q, SEARCH_RADIUS, results);
+        catalog.kNearestTo(10, catalog.featureRow(q), results);
+        incremental.search(catalog, catalog.featureRow(q), results);
+        catalog.kNearestMulti(10, seeds, weights, q % 2 ? SeedAggregate::Min : SeedAggregate::Weighted, results);
+        store.kNearest(10, q, results);
+        store.radius(q, SEARCH_RADIUS, results);
+        store.kNearestTo(10, catalog.featureRow(q), results);
+    };
+
+    for (int q = 0; q < 50; q++){
+        searches(rng() % catalog.size());
+    }
+    warmEveryThread(catalog, seeds, weights);
+    countAllocations = true;
+    for (int q = 0; q < 500; q++){
+        searches(rng() % catalog.size());
+    }
+    countAllocations = false;
+    filesystem::remove_all(dir);
+
+    cout << "allocations in 500 rounds of searches: " << allocationCount << endl;
+    if (allocationCount != 0){
+        cout << "FAIL allocations: searches allocated after warming up" << endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]){
+    Options options;
+    for (int i = 1; i < argc; i++){
+        string arg = argv[i];
+        auto next = [&]() -> string {
+            if (i + 1 >= argc){
+                cerr << "missing value for " << arg << endl;
+                exit(2);
+            }
+            return argv[++i];
+        };
+        if (arg == "--songs") options.songs = stoull(next());
+        else if (arg == "--queries") options.queries = stoi(next());
+        else if (arg == "--seed") options.seed = stoul(next());
+        else if (arg == "--latency-slack") options.latencySlack = stod(next());
+        else if (arg == "--allocations") options.allocations = true;
+        else if (arg == "--scale"){
+            stringstream sizes(next());
+            string size;
+            while (getline(sizes, size, ',')){
+                options.scale.push_back(stoull(size));
+            }
+        }
+        else {
+            cerr << "unknown option " << arg << endl;
+            return 2;
+        }
+    }
+
+    if (options.allocations){
+        return runAllocations(options);
+    }
+    if (options.scale.empty()){
+        options.scale.push_back(options.songs);
+    }
+    int failures = 0;
+    for (size_t songs : options.scale){
+        failures += runSize(songs, options);
+    }
+    if (failures){
+        cout << failures << " regression(s)" << endl;
+        return 1;
+    }
+    cout << "all engines within limits" << endl;
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include "synthetic_catalog.h"
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using namespace std;
+
+void writeSyntheticCatalog(const filesystem::path& path, size_t songs, uint32_t seed){
+    ofstream file(path, ios::binary | ios::trunc);
+    if (!file){
+        throw runtime_error("Failed to open file " + path.string());
+    }
+    file << ",track_id,artists,album_name,track_name,popularity,duration_ms,explicit,danceability,energy,key,"
+            "loudness,mode,speechiness,acousticness,instrumentalness,liveness,valence,tempo,time_signature,track_genre\n";
+
+    static const char* words[] = {"love", "night", "road", "fire", "baby", "dream", "heart", "rain",
+                                  "sun", "city", "blue", "gold", "wild", "home", "time", "dance"};
+    static const char* genres[] = {"pop", "rock", "jazz", "metal", "edm", "folk", "hip-hop", "classical",
+                                   "country", "ambient", "punk", "soul"};
+    const int genreCount = sizeof(genres) / sizeof(genres[0]);
+
+    mt19937 rng(seed);
+    uniform_real_distribution<double> unit(0.0, 1.0);
+    normal_distribution<double> spread(0.0, 0.12);
+    normal_distribution<double> duration(210000.0, 45000.0);
+
+    // energy, speechiness, acousticness, instrumentalness, valence, tempo (0 to 1) around each genre
+    vector<vector<double>> centers(genreCount, vector<double>(6));
+    for (auto& center : centers){
+        for (double& x : center){
+            x = unit(rng);
+        }
+    }
+    auto clamp01 = [](double x){ return x < 0 ? 0 : (x > 1 ? 1 : x); };
+
+    string line;
+    char numbers[256];
+    for (size_t i = 0; i < songs; i++){
+        int genre = rng() % genreCount;
+        double f[6];
+        for (int c = 0; c < 6; c++){
+            f[c] = clamp01(centers[genre][c] + spread(rng));
+        }
+
+        // about 20000 different names whatever the size, so big catalogs are full of versions
+        string track = words[rng() % 16];
+        if (rng() % 2){
+            track += string(" ") + words[rng() % 16];
+        }
+        track += " " + to_string(rng() % 1250);
+
+        string artist = "Artist " + to_string(rng() % 50000);
+        if (rng() % 20 == 0){
+            artist = "\"" + artist + ";Artist " + to_string(rng() % 50000) + "\"";
+        }
+
+        snprintf(numbers, sizeof(numbers),
+                 "%u,%.0f,False,0.5,%.4f,5,-6.0,1,%.4f,%.4f,%.4f,0.2,%.4f,%.3f,4,",
+                 static_cast<unsigned>(rng() % 101), max(30000.0, duration(rng)),
+                 f[0], f[1], f[2], f[3], f[4], 60.0 + 140.0 * f[5]);
+        line.clear();
+        line += to_string(i) + ",id" + to_string(i) + "," + artist + ",album," + track + "," + numbers + genres[genre] + "\n";
+        file << line;
+    }
+    if (!file){
+        throw runtime_error("Failed to write file " + path.string());
+    }
+}
@@ -0,0 +1,13 @@
+// fake song catalogs of any size in the same csv format as dataset.csv
+#pragma once
+#include <cstdint>
+#include <filesystem>
+
+/*
+Writes songs rows to path with the dataset.csv header and columns.
+Features are drawn around a handful of genre centers so there are dense and empty regions like the real data,
+track names come from a small vocabulary so plenty of tracks have versions by several artists,
+and some artists are quoted with ; in them so the csv tokenizer gets its awkward cases too.
+The same seed always gives the same file
+*/
+void writeSyntheticCatalog(const std::filesystem::path& path, size_t songs, uint32_t seed);